@@ -0,0 +1,147 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "perfDataReader.hpp"
+
+#define BENCHMARK_SAMPLES (1000000)
+#define BENCHMARK_CALLCHAIN_DEPTH (16)
+#define BENCHMARK_CHUNK_SIZE (65536)    /* as read from the perf record pipe */
+
+using namespace std;
+
+static void appendRecord(vector<uint8_t>& stream, uint32_t type, const void *body, size_t length)
+{
+    struct perf_event_header header;
+
+    header.type = type;
+    header.misc = 0;
+    header.size = (uint16_t)((sizeof(header) + length + 7) & ~(size_t)7);
+    stream.insert(stream.end(), (const uint8_t *)&header, (const uint8_t *)&header + sizeof(header));
+    stream.insert(stream.end(), (const uint8_t *)body, (const uint8_t *)body + length);
+    stream.resize(stream.size() + header.size - sizeof(header) - length);
+}
+
+/* Builds what "perf record -g -o -" writes for a process sampled on cycles */
+static vector<uint8_t> makePipeStream(void)
+{
+    vector<uint8_t> stream;
+    uint64_t pipeHeader[2] = {PERF_DATA_MAGIC, PERF_DATA_PIPE_HEADER_SIZE};
+    struct perf_event_attr attr;
+    uint64_t body[6 + BENCHMARK_CALLCHAIN_DEPTH];
+    uint8_t attrBody[sizeof(attr) + sizeof(uint64_t)];
+
+    stream.insert(stream.end(), (uint8_t *)pipeHeader, (uint8_t *)pipeHeader + sizeof(pipeHeader));
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_PERIOD | PERF_SAMPLE_CALLCHAIN;
+    memcpy(attrBody, &attr, sizeof(attr));
+    memset(attrBody + sizeof(attr), 0, sizeof(uint64_t));
+    appendRecord(stream, PERF_DATA_RECORD_HEADER_ATTR, attrBody, sizeof(attrBody));
+
+    for (uint64_t i = 0; i < BENCHMARK_SAMPLES; i++)
+    {
+        body[0] = 0x400000 + (i * 2654435761ULL) % 0x100000;   /* ip */
+        body[1] = (1000ULL << 32) | (1000 + i % 64);            /* tid, pid */
+        body[2] = 1000000000ULL + i * 1000;                      /* time */
+        body[3] = 250000;                                        /* period */
+        body[4] = BENCHMARK_CALLCHAIN_DEPTH;
+        for (int frame = 0; frame < BENCHMARK_CALLCHAIN_DEPTH; frame++)
+        {
+            body[5 + frame] = 0x400000 + frame * 0x1000 + i % 0x100;
+        }
+        appendRecord(stream, PERF_RECORD_SAMPLE, body, (5 + BENCHMARK_CALLCHAIN_DEPTH) * sizeof(uint64_t));
+    }
+    return stream;
+}
+
+static vector<uint8_t> readStream(const char *fileName)
+{
+    vector<uint8_t> stream;
+    FILE *file = fopen(fileName, "rb");
+    uint8_t buffer[BENCHMARK_CHUNK_SIZE];
+    size_t length;
+
+    if (file == NULL)
+    {
+        perror("ERROR opening perf data file");
+        exit(1);
+    }
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        stream.insert(stream.end(), buffer, buffer + length);
+    }
+    fclose(file);
+    return stream;
+}
+
+/* Measures how fast PerfDataReader decodes the stream of perf record -o -, which replaced
+ * parsing perf script output. Every sample is one line of perf script output, so samples
+ * per second compare with the lines per second of the text parser.
+ * Usage: perfDataBenchmark [perf.data recorded with perf record -o - > file] [iterations] */
+int main(int argc, char const *argv[])
+{
+    vector<uint8_t> stream = (argc >= 2) ? readStream(argv[1]) : makePipeStream();
+    int iterations = (argc >= 3) ? atoi(argv[2]) : 5;
+    uint64_t samples = 0, callchainFrames = 0;
+    double bestSeconds = 0;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        PerfDataReader reader([&](const perf_sample_t& sample) {
+            samples++;
+            callchainFrames += sample.callchainLength;
+        });
+
+        auto start = chrono::steady_clock::now();
+        for (size_t offset = 0; offset < stream.size(); offset += BENCHMARK_CHUNK_SIZE)
+        {
+            size_t length = min((size_t)BENCHMARK_CHUNK_SIZE, stream.size() - offset);
+            if (!reader.feed(stream.data() + offset, length))
+            {
+                return 1;
+            }
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (i == 0 || seconds < bestSeconds)
+        {
+            bestSeconds = seconds;
+        }
+        if (i == 0)
+        {
+            printf("%llu samples, %llu callchain frames, %zu bytes per iteration\n",
+                   (unsigned long long)reader.getSampleCount(), (unsigned long long)callchainFrames, stream.size());
+        }
+    }
+
+    uint64_t perIteration = samples / (iterations > 0 ? iterations : 1);
+    printf("best of %d: %.3f s, %.0f samples/s (perf script lines/s), %.1f MB/s\n",
+           iterations, bestSeconds, perIteration / bestSeconds, stream.size() / bestSeconds / 1e6);
+    return 0;
+}
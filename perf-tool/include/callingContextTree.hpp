@@ -0,0 +1,55 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef CALLINGCONTEXTTREE_H_
+#define CALLINGCONTEXTTREE_H_
+
+#include <atomic>
+#include <jvmti.h>
+#include <stdint.h>
+
+#define CCT_MAX_NODES (1 << 20)
+#define CCT_STACK_DEPTH (64)    /* deeper stacks are merged under a <truncated> node */
+
+typedef enum {
+    CCT_METRIC_SAMPLES = 0,
+    CCT_METRIC_BYTES,
+    CCT_METRIC_CONTENTIONS,
+    CCT_METRIC_MAX
+} cctMetric_t;
+
+extern std::atomic<bool> callingContextTreeEnabled;
+
+/* Takes the stack of thread (NULL for the current thread) and merges it into the tree.
+ * The tree takes its own stack so that every event source contributes paths of the same
+ * depth. Every sample counts towards CCT_METRIC_SAMPLES, and value is added to metric if
+ * it is another metric. */
+void cctAddSample(jvmtiEnv *jvmtiEnv, jthread thread, cctMetric_t metric, uint64_t value);
+
+/* Starts or stops merging sampled stacks; while enabled the changes since the previous
+ * export are sent every intervalSeconds */
+void setCallingContextTree(bool enabled, int intervalSeconds);
+
+/* Sends the whole tree to the server */
+void requestCallingContextTree(void);
+
+#endif /* CALLINGCONTEXTTREE_H_ */
@@ -36,7 +36,33 @@ JNIEXPORT void JNICALL Exception(jvmtiEnv *jvmtiEnv,
             jmethodID catch_method,
             jlocation catch_location);
 
+JNIEXPORT void JNICALL ExceptionCatch(jvmtiEnv *jvmtiEnv,
+            JNIEnv* jniEnv,
+            jthread thread,
+            jmethodID method,
+            jlocation location,
+            jobject exception);
+
+/* Exception events are shared by exception reporting and unwind tracking,
+ * each can be turned on and off without affecting the other. */
+void setExceptionEventsEnabled(bool enabled);
+bool isExceptionEventsEnabled(void);
+
+/* When enabled, each exception is paired with the catch on the same thread to record how many
+ * frames it unwound and how long that took, aggregated by exception type and by throw and catch
+ * site. The topN site pairs are reported every intervalSeconds. */
+void setExceptionUnwind(bool enabled, int topN, int intervalSeconds);
+bool isExceptionUnwindEnabled(void);
+
+/* Drops the exception the current thread threw but did not catch, called when the thread ends */
+void releasePendingThrow(JNIEnv* jniEnv);
+
 void setExceptionBackTrace(bool val);
 void setExceptionSampleRate(int rate);
 
+/* When enabled, exceptions are only counted per (exception class, throw method, location).
+ * Details are sent for the first detailLimit exceptions of each site and for sampled
+ * exceptions, and a summary of the topN sites is sent every intervalSeconds. */
+void setExceptionAggregate(bool enabled, int detailLimit, int topN, int intervalSeconds);
+
 #endif /* EXCEPTION_H_ */
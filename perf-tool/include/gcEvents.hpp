@@ -0,0 +1,41 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef GCEVENTS_H_
+#define GCEVENTS_H_
+
+#include <jvmti.h>
+
+/* log2 buckets of pause time in microseconds, the last bucket holds everything longer */
+#define GC_PAUSE_HISTOGRAM_BUCKETS (32)
+/* pauses buffered between two reports for the per-pause stream */
+#define GC_PAUSE_RING_SIZE (1024)
+
+/* GC callbacks run with the world stopped, they only read the monotonic clock and update atomics */
+JNIEXPORT void JNICALL GarbageCollectionStart(jvmtiEnv *jvmtiEnv);
+JNIEXPORT void JNICALL GarbageCollectionFinish(jvmtiEnv *jvmtiEnv);
+
+/* Starts or stops timing GC pauses. A summary is sent every intervalSeconds,
+ * along with every individual pause if pauseEvents is set. */
+void setGCEvents(bool enabled, bool pauseEvents, int intervalSeconds);
+
+#endif /* GCEVENTS_H_ */
@@ -0,0 +1,52 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef HEAPHISTOGRAM_H_
+#define HEAPHISTOGRAM_H_
+
+#include <jvmti.h>
+#include <vector>
+
+/* Instance counts and shallow sizes per class, indexed by class tag (see classTags.hpp) */
+struct heap_histogram_t
+{
+    std::vector<jlong> instances;
+    std::vector<jlong> bytes;
+    jlong totalInstances;
+    jlong totalBytes;
+    jlong untaggedInstances;    /* objects of classes loaded after the walk started */
+};
+
+/* Tags every loaded class and walks the heap once. Must run on a thread attached to the VM. */
+bool collectHeapHistogram(jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv, heap_histogram_t& histogram);
+
+#define HEAP_SNAPSHOTS_RETAINED_DEFAULT (5)
+
+/* Walks the heap on the scheduler thread and sends the topN classes by shallow bytes.
+ * The histogram is also retained as a snapshot for heapDiff. */
+void requestHeapHistogram(int topN);
+
+/* Takes a new snapshot, keeping at most retain of them, and sends the topN classes whose
+ * bytes and instance counts grew the most since the previous snapshot */
+void requestHeapDiff(int topN, int retain);
+
+#endif /* HEAPHISTOGRAM_H_ */
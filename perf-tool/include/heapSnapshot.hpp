@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef HEAPSNAPSHOT_H_
+#define HEAPSNAPSHOT_H_
+
+#include <stdio.h>
+#include <string>
+
+/* Streams every reachable object, its references and the class names into fileName,
+ * in the format described in heapSnapshotFormat.hpp. Runs on the scheduler thread.
+ * fileName comes from clients, so it must name a new file in the working directory. */
+void requestHeapSnapshot(const std::string& fileName);
+
+/* Converts a snapshot file to JSON lines, one class, object or reference per line.
+ * Returns false if the file cannot be read or is not a heap snapshot. */
+bool decodeHeapSnapshot(const char *fileName, FILE *out);
+
+#endif /* HEAPSNAPSHOT_H_ */
@@ -0,0 +1,104 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef HEAPSNAPSHOTFORMAT_H_
+#define HEAPSNAPSHOTFORMAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Heap snapshot files, written by the agent and decoded by the client.
+ *
+ * file      := magic version chunk* end
+ * magic     := "PTHEAPSN"
+ * version   := varint
+ * chunk     := type:u8 length:varint payload[length]
+ * end       := HEAP_SNAPSHOT_CHUNK_END 0
+ *
+ * STRINGS    payload: { id:varint length:varint bytes[length] }*
+ * CLASSES    payload: { classId:varint nameId:varint objectId:varint }*
+ * OBJECTS    payload: { classId:varint size:varint arrayLength+1:varint }*, 0 for non-arrays
+ * REFERENCES payload: { kind:u8 zigzag(from - previous from):varint zigzag(to - from):varint }*
+ *
+ * Object ids are implicit: objects are numbered from 1 in the order they appear across all
+ * OBJECTS chunks. A reference from object 0 is a GC root. The previous from is 0 at the start
+ * of every REFERENCES chunk. Reference kinds are the jvmtiHeapReferenceKind values.
+ */
+
+#define HEAP_SNAPSHOT_MAGIC "PTHEAPSN"
+#define HEAP_SNAPSHOT_MAGIC_LENGTH (8)
+#define HEAP_SNAPSHOT_VERSION (1)
+#define HEAP_SNAPSHOT_CHUNK_SIZE (1 << 20)
+#define HEAP_SNAPSHOT_VARINT_MAX (10)
+/* chunks are written once they reach HEAP_SNAPSHOT_CHUNK_SIZE, so they exceed it by at most
+ * one record, the largest being a string of up to 65535 bytes; longer chunks are corrupt */
+#define HEAP_SNAPSHOT_CHUNK_MAX (HEAP_SNAPSHOT_CHUNK_SIZE + (1 << 16) + 2 * HEAP_SNAPSHOT_VARINT_MAX)
+
+enum heap_snapshot_chunk_t
+{
+    HEAP_SNAPSHOT_CHUNK_END = 0,
+    HEAP_SNAPSHOT_CHUNK_STRINGS = 1,
+    HEAP_SNAPSHOT_CHUNK_CLASSES = 2,
+    HEAP_SNAPSHOT_CHUNK_OBJECTS = 3,
+    HEAP_SNAPSHOT_CHUNK_REFERENCES = 4
+};
+
+inline size_t writeVarint(uint8_t *buffer, uint64_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        buffer[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (uint8_t)value;
+    return length;
+}
+
+/* Returns the number of bytes read, or 0 if the varint does not end before end */
+inline size_t readVarint(const uint8_t *buffer, const uint8_t *end, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (size_t i = 0; i < HEAP_SNAPSHOT_VARINT_MAX && buffer + i < end; i++)
+    {
+        result |= (uint64_t)(buffer[i] & 0x7f) << (7 * i);
+        if ((buffer[i] & 0x80) == 0)
+        {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+inline uint64_t zigzagEncode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+#endif /* HEAPSNAPSHOTFORMAT_H_ */
@@ -0,0 +1,47 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef HEAPWALK_H_
+#define HEAPWALK_H_
+
+#include <jvmti.h>
+
+/* Set in the walk environment tag of every class object, the remaining bits are the class tag */
+#define HEAP_WALK_CLASS_BIT ((jlong)1 << 62)
+
+/* Heap walks that tag every object use their own JVMTI environment, so the tags of the
+ * agent's main environment are left alone and all the walk's tags go away with the environment. */
+jvmtiEnv *createHeapWalkEnv(void);
+void disposeHeapWalkEnv(jvmtiEnv *walkEnv);
+
+/* Tags every loaded class in walkEnv with HEAP_WALK_CLASS_BIT | its class tag from classTags.hpp */
+bool tagClassesForHeapWalk(jvmtiEnv *walkEnv, jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv);
+
+/* Class tag of a walk environment class tag, or 0 if the class was not tagged */
+inline jlong heapWalkClassTag(jlong walkTag)
+{
+    return (walkTag & HEAP_WALK_CLASS_BIT) ? (walkTag & ~HEAP_WALK_CLASS_BIT) : 0;
+}
+
+const char *heapReferenceKindName(jvmtiHeapReferenceKind kind);
+
+#endif /* HEAPWALK_H_ */
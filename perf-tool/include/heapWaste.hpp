@@ -0,0 +1,34 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef HEAPWASTE_H_
+#define HEAPWASTE_H_
+
+#define HEAP_WASTE_PREVIEW_LENGTH (40)
+#define HEAP_WASTE_SPARSE_PERCENT (25)  /* object arrays at most this full are reported as sparse */
+
+/* Walks the heap on the scheduler thread and sends the bytes that could be saved by
+ * deduplicating strings and primitive arrays, and by trimming empty or mostly empty
+ * collection backing arrays, for the topN classes of each kind */
+void requestHeapWaste(int topN);
+
+#endif /* HEAPWASTE_H_ */
@@ -0,0 +1,185 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef HEAVYHITTERS_H_
+#define HEAVYHITTERS_H_
+
+#include <algorithm>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/* Space-Saving sketch: keeps the heaviest keys of a weighted stream in a fixed number
+ * of entries. When a new key arrives and the table is full, the lightest entry is
+ * evicted and the new key inherits its weight, which is then recorded as the error
+ * bound on the new entry. Any key heavier than total weight / capacity is guaranteed
+ * to be present. Not thread safe. */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class HeavyHitters
+{
+public:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        uint64_t weight;
+        uint64_t count;
+        uint64_t error;
+    };
+
+private:
+    size_t capacity;
+    std::vector<Entry> entries;
+    /* min-heap of entry indices ordered by weight, and each entry's position in it */
+    std::vector<size_t> heap;
+    std::vector<size_t> heapPosition;
+    std::unordered_map<Key, size_t, Hash> index;
+
+public:
+    HeavyHitters(size_t _capacity) : capacity(_capacity > 0 ? _capacity : 1)
+    {
+        entries.reserve(capacity);
+        heap.reserve(capacity);
+        heapPosition.reserve(capacity);
+        index.reserve(capacity);
+    }
+
+    /* Adds weight to key. Sets isNew when the key was not tracked before,
+     * in which case the caller should fill in the returned entry's value. */
+    Entry& add(const Key& key, uint64_t weight, bool& isNew)
+    {
+        size_t i;
+        auto found = index.find(key);
+
+        isNew = (found == index.end());
+        if (!isNew)
+        {
+            i = found->second;
+        }
+        else if (entries.size() < capacity)
+        {
+            i = entries.size();
+            entries.push_back(Entry{key, Value(), 0, 0, 0});
+            heap.push_back(i);
+            heapPosition.push_back(heap.size() - 1);
+            index[key] = i;
+            siftUp(heap.size() - 1);
+        }
+        else
+        {
+            /* evict the lightest entry, the new key inherits its weight as error */
+            i = heap[0];
+            Entry& evicted = entries[i];
+            index.erase(evicted.key);
+            evicted.key = key;
+            evicted.value = Value();
+            evicted.error = evicted.weight;
+            evicted.count = 0;
+            index[key] = i;
+        }
+
+        Entry& entry = entries[i];
+        entry.weight += weight;
+        entry.count++;
+        siftDown(heapPosition[i]);
+        return entry;
+    }
+
+    /* Returns up to n entries, heaviest first */
+    std::vector<const Entry *> top(size_t n) const
+    {
+        std::vector<const Entry *> result;
+        result.reserve(entries.size());
+        for (const Entry& entry : entries)
+        {
+            result.push_back(&entry);
+        }
+        n = std::min(n, result.size());
+        std::partial_sort(result.begin(), result.begin() + n, result.end(),
+            [](const Entry *a, const Entry *b) {
+                return a->weight > b->weight;
+            });
+        result.resize(n);
+        return result;
+    }
+
+    size_t size(void) const
+    {
+        return entries.size();
+    }
+
+    void clear(void)
+    {
+        entries.clear();
+        heap.clear();
+        heapPosition.clear();
+        index.clear();
+    }
+
+private:
+    void swapHeap(size_t a, size_t b)
+    {
+        std::swap(heap[a], heap[b]);
+        heapPosition[heap[a]] = a;
+        heapPosition[heap[b]] = b;
+    }
+
+    void siftUp(size_t position)
+    {
+        while (position > 0)
+        {
+            size_t parent = (position - 1) / 2;
+            if (entries[heap[parent]].weight <= entries[heap[position]].weight)
+            {
+                break;
+            }
+            swapHeap(parent, position);
+            position = parent;
+        }
+    }
+
+    void siftDown(size_t position)
+    {
+        while (true)
+        {
+            size_t smallest = position;
+            size_t left = 2 * position + 1;
+            size_t right = left + 1;
+            if (left < heap.size() && entries[heap[left]].weight < entries[heap[smallest]].weight)
+            {
+                smallest = left;
+            }
+            if (right < heap.size() && entries[heap[right]].weight < entries[heap[smallest]].weight)
+            {
+                smallest = right;
+            }
+            if (smallest == position)
+            {
+                break;
+            }
+            swapHeap(position, smallest);
+            position = smallest;
+        }
+    }
+};
+
+#endif /* HEAVYHITTERS_H_ */
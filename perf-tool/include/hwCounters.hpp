@@ -0,0 +1,41 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#ifndef HWCOUNTERS_H_
+#define HWCOUNTERS_H_
+
+#include <string>
+#include <vector>
+
+#define HW_COUNTERS_MAX_EVENTS (8)
+
+/* Opens the counter group of the calling thread. Called from ThreadStart, on the new thread. */
+void addThreadToHwCounters(void);
+
+/* Reads the last counts of the calling thread and closes its group, so a thread reusing its
+ * TID gets its own. Called from ThreadEnd, on the ending thread. */
+void removeThreadFromHwCounters(void);
+
+/* Starts or stops counting events in a perf_event_open group per thread. The per-thread
+ * deltas are sent every intervalSeconds. Returns false if none of the events can be counted. */
+bool setHwCounters(bool enabled, const std::vector<std::string>& events, int intervalSeconds);
+
+#endif /* HWCOUNTERS_H_ */
@@ -0,0 +1,70 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#ifndef JITCODEINDEX_H_
+#define JITCODEINDEX_H_
+
+#include <jvmti.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define JIT_CODE_INDEX_READERS (64)         /* threads that can look up without taking the lock */
+#define JIT_CODE_INDEX_BATCH_RATIO (16)     /* changes are published once they reach 1/16 of the index */
+#define JIT_CODE_INDEX_PUBLISH_SECONDS (1)  /* and at the latest after this long */
+
+struct jit_code_frame_t
+{
+    jmethodID method;       /* NULL for code the JVM generated outside methods */
+    std::string symbol;
+    jint bci;               /* -1 when unknown */
+};
+
+struct jit_code_info_t
+{
+    uint64_t start;
+    uint64_t end;
+    /* innermost first: the method the address belongs to, the methods it is inlined
+     * into and last the compiled method */
+    std::vector<jit_code_frame_t> frames;
+};
+
+/* Adds the code of a compiled method, with the inlining records the VM passed as compileInfo
+ * if any. Code overlapping the range is dropped, its memory was reused. */
+void addJitCode(jvmtiEnv *jvmtiEnv, jmethodID method, const void *address, jint length,
+                const std::string& symbol, const void *compileInfo);
+
+/* Adds code the JVM generated outside methods, such as the interpreter or trampolines */
+void addJitStub(const void *address, jint length, const char *name);
+
+void removeJitCode(const void *address);
+
+/* Makes the changes added since the last call visible to lookups */
+void publishJitCode(void);
+
+/* Starts indexing the code compiled before the agent saw it and publishing changes periodically */
+void startJitCodeIndex(void);
+
+/* Finds the code containing address. Lookups never wait for a writer: they search an
+ * immutable sorted snapshot that writers replace. */
+bool lookupJitCode(uint64_t address, jit_code_info_t& info);
+
+#endif /* JITCODEINDEX_H_ */
@@ -32,4 +32,8 @@ JNIEXPORT void JNICALL MethodEntry(jvmtiEnv *jvmtiEnv,
 
 void setMethodEntrySampleRate(int rate);
 
+/* When enabled, every method entry is counted in a per-thread table instead of being
+ * sampled, and the topN methods are reported every intervalSeconds. */
+void setMethodEntryAggregate(bool enabled, int topN, int intervalSeconds);
+
 #endif /* METHODENTRY_H_ */
@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef OBJECTLIFETIME_H_
+#define OBJECTLIFETIME_H_
+
+#include <atomic>
+#include <jvmti.h>
+
+#include "json.hpp"
+
+/*
+ * Sampled allocations are tagged with their site, allocation time and size, so that the
+ * ObjectFree event can retire them from their site's live counters without any lookup:
+ *
+ *   bit 62     LIFETIME_TAG_BIT, class tags never reach it
+ *   bits 46-61 site id
+ *   bits 24-45 size in 8 byte words, saturated
+ *   bits 0-23  allocation time in seconds since the mode was first started, wrapping
+ */
+#define LIFETIME_TAG_BIT ((jlong)1 << 62)
+#define LIFETIME_SITE_BITS (16)
+#define LIFETIME_SIZE_BITS (22)
+#define LIFETIME_TIME_BITS (24)
+#define LIFETIME_SITES_CAPACITY (4096)  /* site 0 collects the allocations of sites that did not fit */
+#define LIFETIME_HISTOGRAM_BUCKETS (LIFETIME_TIME_BITS + 1)
+
+extern std::atomic<bool> objectLifetimeEnabled;
+
+/* Site id of an object tagged by trackObjectLifetime, or -1 for any other tag */
+inline jint lifetimeTagSite(jlong tag)
+{
+    return (tag & LIFETIME_TAG_BIT) ? (jint)((tag >> (LIFETIME_TIME_BITS + LIFETIME_SIZE_BITS)) & (((jlong)1 << LIFETIME_SITE_BITS) - 1)) : -1;
+}
+
+/* objType and objBackTrace of a site, as sent in the objectLifetime report */
+nlohmann::json describeLifetimeSite(jvmtiEnv *jvmtiEnv, jint id);
+
+JNIEXPORT void JNICALL ObjectFree(jvmtiEnv *jvmtiEnv, jlong tag);
+
+/* Tags a sampled allocation and counts it as live against its site */
+void trackObjectLifetime(jvmtiEnv *jvmtiEnv, jobject object, jclass objectClass, jlong size);
+
+/* While enabled, live objects and bytes and the lifetimes of freed objects are reported
+ * for the topN sites by live bytes every intervalSeconds. Counts are kept when the mode
+ * is stopped, so that objects tagged earlier are still retired correctly. */
+void setObjectLifetime(bool enabled, int topN, int intervalSeconds);
+
+#endif /* OBJECTLIFETIME_H_ */
@@ -23,8 +23,17 @@
 #ifndef OBJECTALLOC_H_
 #define OBJECTALLOC_H_
 
+#include <atomic>
 #include <jvmti.h>
 
+#define OBJECT_ALLOC_STACK_TRACE_NUM_FRAMES (10)
+#define ALLOCATION_SITES_CAPACITY (1024)
+#define OBJECT_SIZE_BUCKETS (24)        /* log2 buckets of object sizes, the last one is open ended */
+#define ARRAY_LENGTH_BUCKETS (OBJECT_SIZE_BUCKETS)   /* log2 buckets of array lengths, bucketed like sizes */
+#define OBJECT_SIZE_WINDOW_REPORTS (6)  /* reports covered by the sliding window allocation rate */
+
+extern std::atomic<int> objAllocSampleRate;
+
 JNIEXPORT void JNICALL VMObjectAlloc(jvmtiEnv *jvmtiEnv,
                         JNIEnv* env,
                         jthread thread,
@@ -35,5 +44,15 @@ JNIEXPORT void JNICALL VMObjectAlloc(jvmtiEnv *jvmtiEnv,
 void setObjAllocBackTrace(bool val);
 void setObjAllocSampleRate(int sampleRate);
 
+/* When enabled, sampled allocations are aggregated per (class, stack) in a bounded
+ * heavy-hitters table and the topN sites are reported every intervalSeconds,
+ * instead of sending one message per allocation. */
+void setObjAllocAggregate(bool enabled, int topN, int intervalSeconds);
+
+/* While enabled, every allocation is counted per class in per-thread tables, and size
+ * histograms, array length histograms and allocation rates of the topN classes are
+ * reported every intervalSeconds */
+void setObjAllocSizes(bool enabled, int topN, int intervalSeconds);
+
 
 #endif /* OBJECTALLOC_H_ */
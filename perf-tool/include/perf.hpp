@@ -27,25 +27,45 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <string>
+#include <atomic>
 
 using json = nlohmann::json;
 
-void perfProcess(pid_t processID, int recordTime);
+struct perf_session_config_t;
 
-typedef enum { //to-do: get all options
+/* Records with perf record and decodes its output until the session's time is up or cancelled is set */
+void perfProcess(const perf_session_config_t& config, const std::atomic<bool>& cancelled);
+
+/* Sends the samples of the session's perf.data file */
+void perfDecodeFile(const perf_session_config_t& config);
+
+typedef enum {
     PERF_OPTION_UNKNOWN = 0,
     PERF_OPTION_PID,
     PERF_OPTION_REC_TIME,
     PERF_OPTION_FIELDS,
+    PERF_OPTION_SESSION,
+    PERF_OPTION_EVENTS,
+    PERF_OPTION_FREQUENCY,
+    PERF_OPTION_CALL_GRAPH,
+    PERF_OPTION_INTERVAL,
+    PERF_OPTION_OUTPUT,
+    PERF_OPTION_BACKEND,
+    PERF_OPTION_FILE,
     PERF_OPTION_MAX
 } perfOption_t;
 
+/* Command keys of the perf options, indexed by perfOption_t */
+extern const char *const perfOptionNames[PERF_OPTION_MAX];
+
 typedef enum {
     PERF_FIELD_UNKNOWN = 0,
     PERF_FIELD_PROG,
     PERF_FIELD_PID,
+    PERF_FIELD_TID,
     PERF_FIELD_CPU,
     PERF_FIELD_TIME,
+    PERF_FIELD_EVENT,
     PERF_FIELD_CYCLES,
     PERF_FIELD_ADDRESS,
     PERF_FIELD_INSTRUCTION,
@@ -53,11 +73,7 @@ typedef enum {
     PERF_FIELD_MAX
 } perfField_t;
 
-typedef struct perfFieldRegex {
-    std::string fieldName;
-    std::string fieldRegex;
-} perfFieldRegex;
-
-extern const perfFieldRegex mapRegex[PERF_FIELD_MAX];
+/* JSON names of the sample fields, indexed by perfField_t */
+extern const char *const perfFieldNames[PERF_FIELD_MAX];
 
 #endif
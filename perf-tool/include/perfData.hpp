@@ -0,0 +1,100 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#ifndef PERFDATA_H_
+#define PERFDATA_H_
+
+#include <functional>
+#include <linux/perf_event.h>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "jitCodeIndex.hpp"
+#include "perfDataReader.hpp"
+#include "perfSampler.hpp"
+
+#define PERF_SYMBOL_CACHE_ENTRIES (65536)
+#define PERF_JIT_DSO "[jit]"             /* dso of the code found in the JIT code index */
+
+struct perf_symbol_t
+{
+    const char *symbol;     /* NULL when unknown */
+    uint64_t offset;        /* from the symbol, or from the start of the dso */
+    const char *dso;        /* NULL when unknown */
+};
+
+/* Resolves sampled addresses to symbols with dladdr or the JIT code index for this process
+ * and to the mapped file otherwise, from MMAP records. Resolved addresses are cached and every
+ * name is interned, so the pointers in perf_symbol_t stay valid as long as the symbolizer. */
+class PerfSymbolizer
+{
+    /*
+     * Data members
+     */
+protected:
+public:
+private:
+    struct mapping_t
+    {
+        uint64_t end;
+        uint64_t pageOffset;
+        const char *dso;
+    };
+
+    pid_t selfPid;
+    std::unordered_set<std::string> names;
+    std::unordered_map<uint64_t, perf_symbol_t> cache;
+    std::unordered_map<uint32_t, std::map<uint64_t, mapping_t>> mappings;
+    std::unordered_map<uint32_t, const char *> comms;
+    jit_code_info_t jitCode;
+
+    /*
+     * Function members
+     */
+protected:
+public:
+    PerfSymbolizer();
+
+    void addMapping(const perf_data_mmap_t& mapping);
+    void setComm(uint32_t tid, const char *comm);
+
+    perf_symbol_t resolve(uint32_t pid, uint64_t ip);
+
+    /* Returns the command name of a thread seen in a COMM record, or NULL */
+    const char *getComm(uint32_t tid) const;
+
+    /* Returns the copy of name that lives as long as the symbolizer */
+    const char *intern(const char *name);
+
+private:
+};
+
+struct perf_output_options_t;
+
+/* Sends the fields of one sample selected in options to the server, symbolized and labelled
+ * with the command of its thread */
+void sendPerfSample(const perf_sample_t& sample, uint64_t id, PerfSymbolizer& symbolizer, const perf_output_options_t& options);
+
+#endif /* PERFDATA_H_ */
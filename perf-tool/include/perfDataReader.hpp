@@ -0,0 +1,125 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#ifndef PERFDATAREADER_H_
+#define PERFDATAREADER_H_
+
+#include <functional>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <vector>
+
+#include "perfSampler.hpp"
+
+#define PERF_DATA_MAGIC (0x32454c4946524550ULL)     /* "PERFILE2" */
+#define PERF_DATA_PIPE_HEADER_SIZE (16)
+
+/* Record types perf adds to the kernel's, see tools/perf/util/event.h */
+#define PERF_DATA_RECORD_HEADER_ATTR (64)
+#define PERF_DATA_RECORD_HEADER_TRACING_DATA (66)
+#define PERF_DATA_RECORD_AUXTRACE (71)
+
+
+struct perf_data_section_t
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct perf_data_file_header_t
+{
+    uint64_t magic;
+    uint64_t size;              /* size of this header, PERF_DATA_PIPE_HEADER_SIZE in pipe mode */
+    uint64_t attrSize;          /* size of one entry of the attrs section */
+    perf_data_section_t attrs;
+    perf_data_section_t data;
+    perf_data_section_t eventTypes;
+    uint64_t features[4];
+};
+
+struct perf_data_mmap_t
+{
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t address;
+    uint64_t length;
+    uint64_t pageOffset;
+    const char *fileName;   /* valid during the callback only */
+};
+
+/* Reads the perf.data format written by perf record, either a file or the stream written
+ * by "perf record -o -", without running perf script. Samples are decoded according to the
+ * attributes in the header, and MMAP, MMAP2 and COMM records are passed on so that the
+ * caller can symbolize and label them. Both formats must be in the host byte order. */
+class PerfDataReader
+{
+    /*
+     * Data members
+     */
+protected:
+public:
+private:
+    struct attr_t
+    {
+        struct perf_event_attr attr;
+        const char *event;
+        std::vector<uint64_t> ids;
+    };
+
+    std::function<void(const perf_sample_t&)> onSample;
+    std::function<void(const perf_data_mmap_t&)> onMmap;
+    std::function<void(uint32_t pid, uint32_t tid, const char *comm)> onComm;
+    std::vector<attr_t> attrs;
+    std::vector<uint8_t> pending;
+    uint64_t skipBytes = 0;
+    bool headerRead = false;
+    bool failed = false;
+    uint64_t samples = 0;
+    uint64_t lostSamples = 0;
+
+    /*
+     * Function members
+     */
+protected:
+public:
+    PerfDataReader(std::function<void(const perf_sample_t&)> _onSample,
+                   std::function<void(const perf_data_mmap_t&)> _onMmap = nullptr,
+                   std::function<void(uint32_t pid, uint32_t tid, const char *comm)> _onComm = nullptr);
+
+    /* Reads a whole perf.data file, in file or pipe format. Returns false if it is not one. */
+    bool readFile(const char *fileName);
+
+    /* Decodes the next bytes of a pipe format stream, keeping incomplete records for the
+     * next call. Returns false once the stream turned out not to be perf data. */
+    bool feed(const void *data, size_t length);
+
+    uint64_t getSampleCount(void) const { return samples; }
+    uint64_t getLostCount(void) const { return lostSamples; }
+
+private:
+    bool readPipeHeader(const uint8_t *data, size_t length);
+    void addAttr(const uint8_t *attr, size_t length, const uint64_t *ids, size_t idCount);
+    const attr_t *findAttr(const uint8_t *body, size_t length) const;
+    uint64_t handleRecord(const uint8_t *record, size_t size);
+    void decodeSample(const uint8_t *record, size_t size);
+};
+
+#endif /* PERFDATAREADER_H_ */
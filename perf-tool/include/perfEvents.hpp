@@ -0,0 +1,46 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#ifndef PERFEVENTS_H_
+#define PERFEVENTS_H_
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+
+struct perf_event_type_t
+{
+    const char *name;       /* as given to perf record -e */
+    uint32_t type;
+    uint64_t config;
+};
+
+/* Returns the event of perf's name, or NULL if it is not supported */
+const perf_event_type_t *findPerfEvent(const std::string& name);
+
+/* Returns the perf name of an event, or NULL if it is not in the table */
+const char *getPerfEventName(uint32_t type, uint64_t config);
+
+/* Opens an event counting the thread tid on any cpu, in the group of groupFd unless it is -1 */
+int perfEventOpen(struct perf_event_attr *attr, pid_t tid, int groupFd);
+
+#endif /* PERFEVENTS_H_ */
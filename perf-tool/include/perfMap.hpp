@@ -0,0 +1,45 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#ifndef PERFMAP_H_
+#define PERFMAP_H_
+
+#include <jvmti.h>
+#include <string>
+
+#define PERF_MAP_BUFFER_SIZE (64 * 1024)    /* appends are written once this much is buffered */
+#define PERF_MAP_FLUSH_SECONDS (1)
+#define PERF_MAP_MIN_STALE_ENTRIES (1024)   /* unloaded entries before the file may be rewritten */
+
+/* Keep the JIT code index up to date and, while it is started, the perf map */
+JNIEXPORT void JNICALL CompiledMethodLoad(jvmtiEnv *jvmtiEnv, jmethodID method, jint codeSize, const void *codeAddress,
+                                          jint mapLength, const jvmtiAddrLocationMap *map, const void *compileInfo);
+JNIEXPORT void JNICALL CompiledMethodUnload(jvmtiEnv *jvmtiEnv, jmethodID method, const void *codeAddress);
+JNIEXPORT void JNICALL DynamicCodeGenerated(jvmtiEnv *jvmtiEnv, const char *name, const void *address, jint length);
+
+/* Returns the name of a method as written to the perf map, as in java.lang.String.indexOf(I)I */
+bool getJavaMethodSymbol(jvmtiEnv *jvmtiEnv, jmethodID method, std::string& symbol);
+
+/* Starts or stops writing /tmp/perf-<pid>.map, where perf looks up symbols of JIT code.
+ * Starting rewrites the file from the code that is loaded at that point. */
+void setPerfMap(bool enabled);
+
+#endif /* PERFMAP_H_ */
@@ -0,0 +1,131 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#ifndef PERFPROFILE_H_
+#define PERFPROFILE_H_
+
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "json.hpp"
+#include "perfData.hpp"
+#include "perfSampler.hpp"
+
+using json = nlohmann::json;
+
+#define PERF_FIELDS_ALL (~0u)
+
+struct perf_output_options_t
+{
+    std::string session;    /* name sent with every message */
+    int interval;           /* seconds between profiles, 0 for one profile at the end */
+    bool callGraph;         /* record call chains and report folded stacks */
+    bool sendSamples;       /* send one message per sample instead of profiles */
+    uint32_t fields;        /* bit per perfField_t sent with each sample */
+};
+
+/* Aggregates the samples of a perf session into sample counts and periods per event and
+ * symbol, per event and dso, per event and Java thread and, with call graphs, per event
+ * and folded stack. Names are
+ * interned by the symbolizer, so the tables are keyed by pointer and each profile sends
+ * every name once, in a string table. */
+class PerfProfile
+{
+    /*
+     * Data members
+     */
+protected:
+public:
+private:
+    struct counts_t
+    {
+        uint64_t samples;
+        uint64_t period;
+    };
+
+    struct pointer_pair_hash_t
+    {
+        size_t operator()(const std::pair<const char *, const char *>& key) const
+        {
+            return std::hash<const void *>()(key.first) * 31 + std::hash<const void *>()(key.second);
+        }
+    };
+
+    struct stack_hash_t
+    {
+        size_t operator()(const std::vector<const char *>& stack) const
+        {
+            size_t hash = stack.size();
+            for (const char *frame : stack)
+            {
+                hash = hash * 31 + std::hash<const void *>()(frame);
+            }
+            return hash;
+        }
+    };
+
+    struct event_profile_t
+    {
+        std::unordered_map<std::pair<const char *, const char *>, counts_t, pointer_pair_hash_t> symbols;
+        std::unordered_map<const char *, counts_t> dsos;
+        std::unordered_map<std::pair<const char *, const char *>, counts_t, pointer_pair_hash_t> threads;
+        std::unordered_map<std::vector<const char *>, counts_t, stack_hash_t> stacks;
+        counts_t total = {0, 0};
+    };
+
+    perf_output_options_t options;
+    PerfSymbolizer symbolizer;
+    std::unordered_map<const char *, event_profile_t> events;    /* by event name */
+    /* thread name and group by TID, looked up once per profile since TIDs are reused */
+    std::unordered_map<uint32_t, std::pair<const char *, const char *>> threadLabels;
+    std::vector<const char *> stack;
+    pid_t selfPid;
+    uint64_t sentSamples = 0;
+    std::chrono::steady_clock::time_point nextProfile;
+
+    /*
+     * Function members
+     */
+protected:
+public:
+    PerfProfile(const perf_output_options_t& _options);
+
+    PerfSymbolizer& getSymbolizer(void) { return symbolizer; }
+
+    void addSample(const perf_sample_t& sample);
+
+    /* Sends the profile and starts a new one if the interval has passed */
+    void poll(void);
+
+    /* Sends the last profile and a perfSummary message */
+    void finish(uint64_t samples, uint64_t lost);
+
+private:
+    const std::pair<const char *, const char *>& getThreadLabel(const perf_sample_t& sample);
+    void sendProfile(const char *event, event_profile_t& profile);
+    void sendProfiles(void);
+};
+
+#endif /* PERFPROFILE_H_ */
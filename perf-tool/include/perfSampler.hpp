@@ -0,0 +1,141 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef PERFSAMPLER_H_
+#define PERFSAMPLER_H_
+
+#include <atomic>
+#include <functional>
+#include <linux/perf_event.h>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "perfEvents.hpp"
+
+#define PERF_SAMPLER_RING_PAGES (16)        /* data pages per thread, must be a power of two */
+#define PERF_SAMPLER_MAX_CALLCHAIN (127)
+#define PERF_SAMPLER_POLL_MILLIS (100)
+#define PERF_SAMPLE_NO_CPU (UINT32_MAX)     /* cpu of samples recorded without PERF_SAMPLE_CPU */
+
+struct perf_sampler_config_t
+{
+    const char *name;       /* event name passed on in samples */
+    uint32_t type;          /* PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE, ... */
+    uint64_t config;        /* PERF_COUNT_HW_CPU_CYCLES, ... */
+    uint64_t frequency;     /* samples per second per thread */
+    bool callGraph;
+};
+
+struct perf_sample_t
+{
+    const char *event;
+    uint64_t ip;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t time;
+    uint32_t cpu;
+    uint64_t period;
+    uint64_t callchainLength;
+    const uint64_t *callchain;  /* innermost first, valid during the callback only */
+};
+
+/* Samples the threads of this process with perf_event_open, one event and one mmap'd
+ * ring buffer per thread, and decodes PERF_RECORD_SAMPLE records in-process. Threads
+ * that exist when the sampler starts are found in /proc/self/task, threads started
+ * later are added from the ThreadStart event. The ring of a thread is closed once it is
+ * drained after ThreadEnd, or after the kernel hangs up its event when the thread exits.
+ * Rings are only drained and closed on the thread that polls, without holding ringsMutex,
+ * so ThreadStart and ThreadEnd never wait for samples to be decoded. */
+class PerfSampler
+{
+    /*
+     * Data members
+     */
+protected:
+public:
+private:
+    struct ring_t
+    {
+        pid_t tid;
+        int fd;
+        void *base;
+        std::atomic<bool> ended;    /* set from ThreadEnd, closed by the next poll */
+    };
+
+    perf_sampler_config_t config;
+    std::function<void(const perf_sample_t&)> onSample;
+    std::mutex ringsMutex;          /* guards the list, not the rings' contents */
+    std::vector<std::unique_ptr<ring_t>> rings;
+    std::vector<uint8_t> wrapBuffer;
+    uint64_t lostSamples = 0;
+    uint64_t samples = 0;
+    size_t pageSize;
+
+    /*
+     * Function members
+     */
+protected:
+public:
+    PerfSampler(const perf_sampler_config_t& _config, std::function<void(const perf_sample_t&)> _onSample);
+    ~PerfSampler();
+
+    /* Opens an event for every thread of the process. Returns false if none could be opened. */
+    bool start(void);
+
+    /* Opens an event for one more thread */
+    bool addThread(pid_t tid);
+
+    /* Disables the event of a thread that is ending; poll decodes what is left and closes it */
+    void removeThread(pid_t tid);
+
+    /* Waits up to timeoutMillis for data and decodes every complete record */
+    void poll(int timeoutMillis);
+
+    /* Disables and closes every event, after decoding what is left in the rings */
+    void stop(void);
+
+    uint64_t getSampleCount(void) const { return samples; }
+    uint64_t getLostCount(void) const { return lostSamples; }
+
+private:
+    void drain(ring_t& ring);
+    void closeRing(ring_t& ring);
+    void decodeSample(const uint8_t *record, size_t size);
+};
+
+/* Adds the calling thread to every running sampler. Called from ThreadStart. */
+void addThreadToPerfSamplers(void);
+
+/* Removes the calling thread from every running sampler. Called from ThreadEnd. */
+void removeThreadFromPerfSamplers(void);
+
+struct perf_session_config_t;
+
+/* Samples the process until the session's time is up or cancelled is set, and sends
+ * profiles or samples to the server */
+void perfSampleProcess(const perf_session_config_t& config, const std::atomic<bool>& cancelled);
+
+#endif /* PERFSAMPLER_H_ */
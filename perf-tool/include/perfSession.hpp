@@ -0,0 +1,126 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#ifndef PERFSESSION_H_
+#define PERFSESSION_H_
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+#include "json.hpp"
+#include "perfProfile.hpp"
+
+using json = nlohmann::json;
+
+#define PERF_SESSION_DEFAULT_NAME "default"
+#define PERF_SESSION_DEFAULT_FREQUENCY (1000)
+
+struct perf_session_config_t
+{
+    std::string name;
+    pid_t pid;                          /* process recorded by the external backend */
+    int recordTime;                     /* seconds, 0 to record until the session is stopped */
+    std::vector<std::string> events;    /* perf event names, see findPerfEvent() */
+    uint64_t frequency;                 /* samples per second */
+    bool external;                      /* run perf record instead of sampling in-process */
+    std::string file;                   /* perf.data file to decode instead of recording */
+    perf_output_options_t output;
+};
+
+/* Fills config from the options of a perf command, keyed by perfOptionNames. Returns false
+ * and prints the reason if an option has an invalid value. */
+bool parsePerfSessionConfig(const json& command, perf_session_config_t& config);
+
+/* One perf recording, run by one of the backends on its own thread */
+class PerfSession
+{
+    /*
+     * Data members
+     */
+protected:
+public:
+private:
+    perf_session_config_t config;
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> finished{false};
+    std::chrono::steady_clock::time_point startTime;
+    std::thread thread;
+
+    /*
+     * Function members
+     */
+protected:
+public:
+    PerfSession(const perf_session_config_t& _config);
+    ~PerfSession();
+
+    void start(void);
+
+    /* Asks the backend to stop early. It still sends what it recorded. */
+    void cancel(void) { cancelled = true; }
+
+    void join(void);
+
+    bool isFinished(void) const { return finished; }
+
+    json getStatus(void) const;
+
+private:
+    void run(void);
+};
+
+/* Runs named perf sessions side by side, for the perf functionality's start, stop and
+ * status commands */
+class PerfSessionManager
+{
+    /*
+     * Data members
+     */
+protected:
+public:
+private:
+    std::mutex sessionsMutex;
+    std::map<std::string, std::unique_ptr<PerfSession>> sessions;
+
+    /*
+     * Function members
+     */
+protected:
+public:
+    void handleCommand(const json& command);
+
+    /* Cancels every session and waits until each has sent its data */
+    void stopAll(void);
+
+private:
+    void startSession(const json& command);
+    void stopSession(const std::string& name);
+    void sendStatus(void);
+};
+
+#endif /* PERFSESSION_H_ */
@@ -0,0 +1,49 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <functional>
+#include <jvmti.h>
+#include <string>
+
+/* Tasks run on a single agent thread attached to the VM, so they may call JVMTI and JNI
+ * functions and never run concurrently with each other. */
+typedef std::function<void(jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv)> agentTask_t;
+
+/* Runs task every intervalSeconds, replacing any task previously scheduled under name */
+void schedulePeriodicTask(const std::string& name, int intervalSeconds, agentTask_t task);
+
+/* Removes a periodic task after running it one final time so no data is lost */
+void cancelPeriodicTask(const std::string& name);
+
+/* Runs a periodic task as soon as possible without changing its schedule */
+void runPeriodicTaskNow(const std::string& name);
+
+/* Runs task once, as soon as possible */
+void submitTask(agentTask_t task);
+
+/* Runs every periodic task a final time and stops the scheduler thread */
+void shutDownScheduler(void);
+
+#endif /* SCHEDULER_H_ */
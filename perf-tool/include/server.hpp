@@ -30,6 +30,7 @@
 
 #include "serverClients.hpp"
 #include "json.hpp"
+#include "perfSession.hpp"
 
 using json = nlohmann::json;
 
@@ -53,7 +54,7 @@ private:
     NetworkClient *networkClients[ServerConstants::NUM_CLIENTS];
     CommandClient *commandClient;
     LoggingClient *loggingClient;
-    std::thread perfThread;
+    PerfSessionManager perfSessions;
     std::vector<delayed_command_t> delayedCommands;
 
     /*
@@ -80,7 +81,8 @@ private:
 
     void sendMessage(const int socketFd, const std::string message);
 
-    void startPerfThread(int time);
+    /* Runs a command now, perf commands in the perf session manager */
+    void dispatchCommand(const json& command);
 };
 
 #endif /* SERVER_H_ */
@@ -0,0 +1,76 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef SHARDEDTABLE_H_
+#define SHARDEDTABLE_H_
+
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+/* Hash map split into independently locked shards, so threads updating
+ * different keys rarely contend on the same lock. */
+template <typename Key, typename Value, typename Hash, int NumShards = 16>
+class ShardedTable
+{
+private:
+    struct Shard
+    {
+        std::mutex shardMutex;
+        std::unordered_map<Key, Value, Hash> values;
+    };
+
+    Shard shards[NumShards];
+
+public:
+    /* Calls f on the value of key, default constructing it first if needed, and returns its result */
+    template <typename F>
+    auto update(const Key& key, F f) -> decltype(f(std::declval<Value&>()))
+    {
+        Shard& shard = shards[Hash()(key) % NumShards];
+        std::lock_guard<std::mutex> lock(shard.shardMutex);
+        return f(shard.values[key]);
+    }
+
+    /* Copies every value, each shard is consistent on its own */
+    std::unordered_map<Key, Value, Hash> snapshot(void)
+    {
+        std::unordered_map<Key, Value, Hash> values;
+        for (Shard& shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.shardMutex);
+            values.insert(shard.values.begin(), shard.values.end());
+        }
+        return values;
+    }
+
+    void clear(void)
+    {
+        for (Shard& shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.shardMutex);
+            shard.values.clear();
+        }
+    }
+};
+
+#endif /* SHARDEDTABLE_H_ */
@@ -0,0 +1,45 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef STACKS_H_
+#define STACKS_H_
+
+#include <jvmti.h>
+#include <stdint.h>
+
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+/* Hash identifying a stack trace, equal stacks always hash to the same id */
+uint64_t hashStackTrace(const jvmtiFrameInfo *frames, jint count);
+
+/* Returns the source line of location in method, or -1 if unavailable */
+int getLineNumber(jvmtiEnv *jvmtiEnv, jmethodID method, jlocation location);
+
+/* Resolves a frame to {methodName, methodSignature, methodClass, methodLineNum} */
+json describeFrame(jvmtiEnv *jvmtiEnv, jmethodID method, jlocation location);
+
+/* Resolves frames, innermost first, into a json array of describeFrame() objects */
+json describeStackTrace(jvmtiEnv *jvmtiEnv, const jvmtiFrameInfo *frames, jint count);
+
+#endif /* STACKS_H_ */
@@ -0,0 +1,275 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef THREADLOCALCOUNTERS_H_
+#define THREADLOCALCOUNTERS_H_
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/* Open-addressing table of counters written by a single thread and read concurrently
+ * by a merging thread. Keys are published with release semantics after their counters
+ * are initialised, and counters are updated with relaxed stores, so readers never
+ * block the owner. A zero key marks an empty slot. */
+template <typename Key, int NumCounters>
+class CounterTable
+{
+public:
+    struct Slot
+    {
+        std::atomic<Key> key;
+        std::atomic<uint64_t> counters[NumCounters];
+    };
+
+private:
+    size_t mask;
+    size_t used = 0;
+    Slot *slots;
+
+public:
+    CounterTable(size_t capacity) : mask(capacity - 1)
+    {
+        /* capacity must be a power of two */
+        slots = new Slot[capacity];
+        for (size_t i = 0; i < capacity; i++)
+        {
+            slots[i].key.store(Key(), std::memory_order_relaxed);
+            for (int c = 0; c < NumCounters; c++)
+            {
+                slots[i].counters[c].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    ~CounterTable()
+    {
+        delete[] slots;
+    }
+
+    size_t capacity(void) const
+    {
+        return mask + 1;
+    }
+
+    /* Adds amount to one counter of key. Only the owning thread may call this.
+     * Returns false when the key is new and the table is too full to take it. */
+    bool add(Key key, int counter, uint64_t amount)
+    {
+        size_t i = hashKey(key) & mask;
+        while (true)
+        {
+            Key slotKey = slots[i].key.load(std::memory_order_relaxed);
+            if (slotKey == key)
+            {
+                std::atomic<uint64_t>& value = slots[i].counters[counter];
+                value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+                return true;
+            }
+            if (slotKey == Key())
+            {
+                if ((used + 1) * 4 > capacity() * 3)
+                {
+                    return false;
+                }
+                slots[i].counters[counter].store(amount, std::memory_order_relaxed);
+                slots[i].key.store(key, std::memory_order_release);
+                used++;
+                return true;
+            }
+            i = (i + 1) & mask;
+        }
+    }
+
+    /* Copies every counter into a table of twice the capacity. Only the owner may call this. */
+    CounterTable *grow(void) const
+    {
+        CounterTable *bigger = new CounterTable(capacity() * 2);
+        forEach([bigger](Key key, const uint64_t *counters) {
+            for (int c = 0; c < NumCounters; c++)
+            {
+                bigger->add(key, c, counters[c]);
+            }
+        });
+        return bigger;
+    }
+
+    /* Calls f(key, counters) for every key. Safe to call from any thread. */
+    template <typename F>
+    void forEach(F f) const
+    {
+        uint64_t counters[NumCounters];
+        for (size_t i = 0; i <= mask; i++)
+        {
+            Key key = slots[i].key.load(std::memory_order_acquire);
+            if (key != Key())
+            {
+                for (int c = 0; c < NumCounters; c++)
+                {
+                    counters[c] = slots[i].counters[c].load(std::memory_order_relaxed);
+                }
+                f(key, counters);
+            }
+        }
+    }
+
+private:
+    static size_t hashKey(Key key)
+    {
+        uint64_t hash = (uint64_t)key;
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return (size_t)hash;
+    }
+};
+
+/* Per-thread CounterTables that are merged on demand. Each thread owns a table that
+ * only it writes, so counting never takes a lock. Tables of threads that have ended
+ * are folded into a running total and freed by the merging thread. */
+template <typename Key, int NumCounters>
+class ThreadLocalCounters
+{
+public:
+    typedef std::array<uint64_t, NumCounters> Counters;
+    typedef std::unordered_map<Key, Counters> Totals;
+
+    struct ThreadTable
+    {
+        std::atomic<CounterTable<Key, NumCounters> *> table;
+        std::atomic<bool> alive;
+    };
+
+    /* Declared thread_local by the user of the counters. Marks the table as
+     * ended when the thread exits so the merging thread can reclaim it. */
+    struct Holder
+    {
+        ThreadTable *threadTable = nullptr;
+
+        ~Holder()
+        {
+            if (threadTable != nullptr)
+            {
+                threadTable->alive.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+private:
+    static constexpr size_t INITIAL_CAPACITY = 256;
+
+    std::mutex registryMutex;
+    std::vector<ThreadTable *> threadTables;
+    std::vector<CounterTable<Key, NumCounters> *> retiredTables;
+    Totals endedThreadTotals;
+
+public:
+    /* Adds amount to counter of key in the calling thread's table */
+    void add(Holder& holder, Key key, int counter, uint64_t amount)
+    {
+        ThreadTable *threadTable = holder.threadTable;
+        if (threadTable == nullptr)
+        {
+            threadTable = holder.threadTable = registerThread();
+        }
+
+        CounterTable<Key, NumCounters> *table = threadTable->table.load(std::memory_order_relaxed);
+        while (!table->add(key, counter, amount))
+        {
+            CounterTable<Key, NumCounters> *bigger = table->grow();
+            threadTable->table.store(bigger, std::memory_order_release);
+
+            /* the merging thread may still be reading the old table, it frees it later */
+            std::lock_guard<std::mutex> lock(registryMutex);
+            retiredTables.push_back(table);
+            table = bigger;
+        }
+    }
+
+    /* Sums the counters of every thread, including threads that have ended */
+    Totals merge(void)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+
+        for (CounterTable<Key, NumCounters> *table : retiredTables)
+        {
+            delete table;
+        }
+        retiredTables.clear();
+
+        Totals totals;
+        for (size_t i = 0; i < threadTables.size();)
+        {
+            ThreadTable *threadTable = threadTables[i];
+            /* once a thread has ended its table no longer changes and can be folded away */
+            bool ended = !threadTable->alive.load(std::memory_order_acquire);
+            CounterTable<Key, NumCounters> *table = threadTable->table.load(std::memory_order_acquire);
+
+            table->forEach([&](Key key, const uint64_t *counters) {
+                Counters& total = ended ? endedThreadTotals[key] : totals[key];
+                for (int c = 0; c < NumCounters; c++)
+                {
+                    total[c] += counters[c];
+                }
+            });
+
+            if (ended)
+            {
+                delete table;
+                delete threadTable;
+                threadTables[i] = threadTables.back();
+                threadTables.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        for (auto& entry : endedThreadTotals)
+        {
+            Counters& total = totals[entry.first];
+            for (int c = 0; c < NumCounters; c++)
+            {
+                total[c] += entry.second[c];
+            }
+        }
+        return totals;
+    }
+
+private:
+    ThreadTable *registerThread(void)
+    {
+        ThreadTable *threadTable = new ThreadTable;
+        threadTable->table.store(new CounterTable<Key, NumCounters>(INITIAL_CAPACITY), std::memory_order_relaxed);
+        threadTable->alive.store(true, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        threadTables.push_back(threadTable);
+        return threadTable;
+    }
+};
+
+#endif /* THREADLOCALCOUNTERS_H_ */
@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef THREADS_H_
+#define THREADS_H_
+
+#include <atomic>
+#include <jvmti.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+JNIEXPORT void JNICALL ThreadStart(jvmtiEnv *jvmtiEnv,
+            JNIEnv* jniEnv,
+            jthread thread);
+
+JNIEXPORT void JNICALL ThreadEnd(jvmtiEnv *jvmtiEnv,
+            JNIEnv* jniEnv,
+            jthread thread);
+
+struct java_thread_info_t
+{
+    std::string name;
+    std::string group;
+};
+
+/* Adds the threads that were started before ThreadStart was enabled to the OS TID map */
+void registerLiveJavaThreads(jvmtiEnv *jvmtiEnv, JNIEnv* jniEnv);
+
+/* Looks up the Java thread running on an OS thread. Readers share a lock, so samplers
+ * and periodic reports can call it often. */
+bool lookupJavaThread(pid_t tid, java_thread_info_t& info);
+
+/* Only threads whose name matches one of namePatterns and whose group matches
+ * one of groupPatterns are of interest. An empty list matches every thread. */
+void setThreadFilter(const std::vector<std::string>& namePatterns, const std::vector<std::string>& groupPatterns);
+void clearThreadFilter(void);
+
+/* Matches the thread against the active filter and caches the verdict for the current thread */
+bool classifyThread(jvmtiEnv *jvmtiEnv, JNIEnv* jniEnv, jthread thread, int generation);
+
+/* Generation of the active thread filter, 0 when no filter is set */
+extern std::atomic<int> threadFilterGeneration;
+
+/* Filter generation the current thread was last classified against, and the verdict */
+extern thread_local int threadFilterVerdictGeneration;
+extern thread_local bool threadFilterVerdict;
+
+/* Returns true if events from the current thread should be ignored.
+ * thread must be the current thread, as passed to the event callbacks. */
+inline bool isThreadFiltered(jvmtiEnv *jvmtiEnv, JNIEnv* jniEnv, jthread thread)
+{
+    int generation = threadFilterGeneration.load(std::memory_order_relaxed);
+    if (generation == 0)
+    {
+        return false;
+    }
+    if (threadFilterVerdictGeneration == generation)
+    {
+        return !threadFilterVerdict;
+    }
+    return !classifyThread(jvmtiEnv, jniEnv, thread, generation);
+}
+
+#endif /* THREADS_H_ */
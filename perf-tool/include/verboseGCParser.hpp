@@ -0,0 +1,110 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#ifndef VERBOSE_GC_PARSER_H_
+#define VERBOSE_GC_PARSER_H_
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+#define VERBOSE_GC_MAX_ATTRIBUTES (16)
+#define VERBOSE_GC_MAX_TYPE_LENGTH (32)
+
+struct verbose_gc_space_t
+{
+    uint64_t usedBefore;
+    uint64_t usedAfter;
+    uint64_t total;
+};
+
+/* One stop-the-world pause, from exclusive-start to exclusive-end */
+struct verbose_gc_cycle_t
+{
+    uint64_t id;
+    char type[VERBOSE_GC_MAX_TYPE_LENGTH];   /* scavenge, global, ... */
+    char cause[VERBOSE_GC_MAX_TYPE_LENGTH];  /* nursery or tenure allocation failure, system GC reason, ... */
+    uint64_t bytesRequested;
+    double intervalMs;                       /* time since the previous exclusive access */
+    double pauseMs;                          /* exclusive access duration */
+    double gcMs;                             /* summed gc-end durations within the pause */
+    int gcCount;
+    verbose_gc_space_t heap;
+    verbose_gc_space_t nursery;
+    verbose_gc_space_t tenure;
+};
+
+/* Incremental parser for OpenJ9 verbose GC XML. Records are scanned in place, tag by tag,
+ * without building a document or copying attribute values, and a verbose_gc_cycle_t is
+ * handed to the callback at the end of every pause. A tag split across two records is
+ * carried over to the next one. */
+class VerboseGCParser
+{
+    /*
+     * Data members
+     */
+protected:
+public:
+private:
+    struct attribute_t
+    {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    enum section_t
+    {
+        SECTION_NONE,
+        SECTION_BEFORE,
+        SECTION_AFTER
+    };
+
+    std::function<void(const verbose_gc_cycle_t&)> onCycle;
+    std::string carry;
+    verbose_gc_cycle_t cycle;
+    bool inExclusive = false;
+    bool haveBefore = false;
+    section_t section = SECTION_NONE;
+    attribute_t attributes[VERBOSE_GC_MAX_ATTRIBUTES];
+    int attributeCount = 0;
+
+    /*
+     * Function members
+     */
+protected:
+public:
+    VerboseGCParser(std::function<void(const verbose_gc_cycle_t&)> _onCycle);
+
+    void parse(const char *record, size_t length);
+
+private:
+    size_t parseTags(std::string_view text);
+    void handleTag(std::string_view name, bool closing);
+    std::string_view attribute(const char *name) const;
+    uint64_t attributeInt(const char *name) const;
+    double attributeDouble(const char *name) const;
+    void copyAttribute(const char *name, char *destination) const;
+    void resetCycle(void);
+};
+
+#endif /* VERBOSE_GC_PARSER_H_ */
@@ -26,6 +26,13 @@
 #include <ibmjvmti.h>
 #include <atomic>
 
+enum verbose_log_format_t
+{
+    VERBOSE_LOG_FORMAT_STRUCTURED,  /* one verboseGC message per pause, every record is parsed */
+    VERBOSE_LOG_FORMAT_RAW,         /* sampled passthrough of the XML records */
+    VERBOSE_LOG_FORMAT_BOTH
+};
+
 void verboseAlarmCallback(jvmtiEnv *jvmti_env, void *subscription_id, void *user_data);
 jvmtiError verboseSubscriberCallback(jvmtiEnv *jvmti_env, const char *record, jlong length, void *user_data);
 
@@ -51,6 +58,7 @@ public:
     }
 
     void setVerboseGCLogSampleRate(int rate);
+    void setVerboseGCLogFormat(verbose_log_format_t format);
     void Subscribe();
     void Unsubscribe();
 
@@ -34,12 +34,17 @@
 #include "methodEntry.hpp"
 #include "monitor.hpp"
 #include "objectalloc.hpp"
+#include "objectLifetime.hpp"
 #include "server.hpp"
 #include "exception.hpp"
+#include "gcEvents.hpp"
+#include "threads.hpp"
+#include "perfMap.hpp"
 
 using json = nlohmann::json;
 
 jvmtiEnv *jvmti;
+JavaVM *javaVM;
 
 /* Server arguments with defaults */
 int portNo = 9002;
@@ -112,6 +117,7 @@ JNIEXPORT jint JNICALL Agent_OnLoad(JavaVM *jvm, char *options, void *reserved)
     printf("%s\n", logPath.c_str());
     printf("%i\n", portNo);
 
+    javaVM = jvm;
     jint rest = jvm->GetEnv((void **) &jvmti, JVMTI_VERSION_1_2);
     if (rest != JNI_OK || jvmti == NULL) {
 
@@ -132,6 +138,9 @@ JNIEXPORT jint JNICALL Agent_OnLoad(JavaVM *jvm, char *options, void *reserved)
     capa.can_generate_monitor_events = 1;
     capa.can_generate_exception_events = 1;
     capa.can_get_source_file_name = 1;
+    capa.can_generate_garbage_collection_events = 1;
+    capa.can_generate_object_free_events = 1;
+    capa.can_generate_compiled_method_load_events = 1;
     error = jvmti->AddCapabilities(&capa);
     check_jvmti_error(jvmti, error, "Failed to set jvmtiCapabilities.");
 
@@ -141,6 +150,22 @@ JNIEXPORT jint JNICALL Agent_OnLoad(JavaVM *jvm, char *options, void *reserved)
     error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_VM_DEATH, (jthread)NULL);
     check_jvmti_error(jvmti, error, "Unable to init VM death eventVerboseLogSubscriber.");
 
+    error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_THREAD_START, (jthread)NULL);
+    check_jvmti_error(jvmti, error, "Unable to init thread start event.");
+
+    error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_THREAD_END, (jthread)NULL);
+    check_jvmti_error(jvmti, error, "Unable to init thread end event.");
+
+    /* JIT code is indexed from the start so native samples of this process resolve to Java methods */
+    error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_COMPILED_METHOD_LOAD, (jthread)NULL);
+    check_jvmti_error(jvmti, error, "Unable to init compiled method load event.");
+
+    error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_COMPILED_METHOD_UNLOAD, (jthread)NULL);
+    check_jvmti_error(jvmti, error, "Unable to init compiled method unload event.");
+
+    error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_DYNAMIC_CODE_GENERATED, (jthread)NULL);
+    check_jvmti_error(jvmti, error, "Unable to init dynamic code generated event.");
+
     jvmtiEventCallbacks callbacks;
     memset(&callbacks, 0, sizeof(jvmtiEventCallbacks));
     callbacks.VMInit = &VMInit;
@@ -149,6 +174,15 @@ JNIEXPORT jint JNICALL Agent_OnLoad(JavaVM *jvm, char *options, void *reserved)
     callbacks.MonitorContendedEntered = &MonitorContendedEntered;
     callbacks.MethodEntry = &MethodEntry;
     callbacks.Exception = &Exception;
+    callbacks.ExceptionCatch = &ExceptionCatch;
+    callbacks.ThreadStart = &ThreadStart;
+    callbacks.ThreadEnd = &ThreadEnd;
+    callbacks.GarbageCollectionStart = &GarbageCollectionStart;
+    callbacks.GarbageCollectionFinish = &GarbageCollectionFinish;
+    callbacks.ObjectFree = &ObjectFree;
+    callbacks.CompiledMethodLoad = &CompiledMethodLoad;
+    callbacks.CompiledMethodUnload = &CompiledMethodUnload;
+    callbacks.DynamicCodeGenerated = &DynamicCodeGenerated;
     error = jvmti->SetEventCallbacks(&callbacks, (jint)sizeof(callbacks));
     check_jvmti_error(jvmti, error, "Cannot set jvmti callbacks.");
 
@@ -24,9 +24,13 @@
 #include <ibmjvmti.h>
 #include <string>
 #include <cstring>
+#include <climits>
 #include <stdio.h>
+#include <time.h>
 #include <iostream>
+#include <regex>
 #include <unistd.h>
+#include <vector>
 
 #include "agentOptions.hpp"
 #include "infra.hpp"
@@ -35,6 +39,16 @@
 #include "exception.hpp"
 #include "methodEntry.hpp"
 #include "verboseLog.hpp"
+#include "threads.hpp"
+#include "callingContextTree.hpp"
+#include "gcEvents.hpp"
+#include "heapHistogram.hpp"
+#include "retainedSize.hpp"
+#include "heapWaste.hpp"
+#include "heapSnapshot.hpp"
+#include "objectLifetime.hpp"
+#include "hwCounters.hpp"
+#include "perfMap.hpp"
 
 #include "json.hpp"
 
@@ -57,6 +71,37 @@ void invalidRate(const std::string& function, const std::string& command, int sa
     printf("Invalid rate with parameters: {functionality: %s, command: %s, sampleRate: %i}\n", function.c_str(), command.c_str(), sampleRate);
 }
 
+/* Returns an optional integer parameter of a command, or defaultValue if it is absent or not an integer */
+int getCommandOption(const json& jCommand, const char *key, int defaultValue)
+{
+    if (jCommand.contains(key))
+    {
+        const json& value = jCommand[key];
+        if (value.is_number_unsigned() ? value.get<uint64_t>() <= INT_MAX
+            : value.is_number_integer() && value.get<int64_t>() >= INT_MIN && value.get<int64_t>() <= INT_MAX)
+        {
+            return value.get<int>();
+        }
+        printf("Invalid value for %s: %s, using %i\n", key, value.dump().c_str(), defaultValue);
+    }
+    return defaultValue;
+}
+
+/* Returns an optional boolean parameter of a command, or defaultValue if it is absent or not a boolean */
+bool getCommandFlag(const json& jCommand, const char *key, bool defaultValue)
+{
+    if (jCommand.contains(key))
+    {
+        const json& value = jCommand[key];
+        if (value.is_boolean())
+        {
+            return value.get<bool>();
+        }
+        printf("Invalid value for %s: %s, using %s\n", key, value.dump().c_str(), defaultValue ? "true" : "false");
+    }
+    return defaultValue;
+}
+
 void modifyMonitorEvents(const std::string& function, const std::string& command, int rate)
 {
     jvmtiCapabilities capa;
@@ -111,7 +156,7 @@ void modifyMonitorEvents(const std::string& function, const std::string& command
     return;
 }
 
-void modifyObjectAllocEvents(const std::string& function,const std::string& command, int sampleRate)
+void modifyObjectAllocEvents(const std::string& function,const std::string& command, int sampleRate, const json& jCommand)
 {
     jvmtiCapabilities capa;
     jvmtiError error;
@@ -120,6 +165,19 @@ void modifyObjectAllocEvents(const std::string& function,const std::string& comm
     error = jvmti->GetCapabilities(&capa);
     check_jvmti_error(jvmti, error, "Unable to get current capabilties.");
     setObjAllocSampleRate(sampleRate);
+    if (!command.compare("start"))
+    {
+        std::string mode = jCommand.value("mode", std::string("events"));
+        setObjAllocAggregate(!mode.compare("aggregate"), getCommandOption(jCommand, "topN", 20), getCommandOption(jCommand, "interval", 10));
+        setObjectLifetime(!mode.compare("lifetime"), getCommandOption(jCommand, "topN", 20), getCommandOption(jCommand, "interval", 10));
+        setObjAllocSizes(jCommand.value("sizeHistograms", false), getCommandOption(jCommand, "topN", 20), getCommandOption(jCommand, "interval", 10));
+    }
+    else if (!command.compare("stop"))
+    {
+        setObjAllocAggregate(false, 0, 0);
+        setObjectLifetime(false, 0, 0);
+        setObjAllocSizes(false, 0, 0);
+    }
     if (capa.can_generate_vm_object_alloc_events)
     {
         if (!command.compare("stop"))
@@ -187,17 +245,20 @@ void modifyMonitorStackTrace(const std::string& function, const std::string& com
     }
 }
 
-void modifyMethodEntryEvents(const std::string& function, const std::string& command, int sampleRate)
+void modifyMethodEntryEvents(const std::string& function, const std::string& command, int sampleRate, const json& jCommand)
 {
     jvmtiError error;
     setMethodEntrySampleRate(sampleRate);
     if (!command.compare("stop"))
     {
+        setMethodEntryAggregate(false, 0, 0);
         error = jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_METHOD_ENTRY, (jthread)NULL);
         check_jvmti_error(jvmti, error, "Unable to disable MethodEntry event.");
     }
     else if (!command.compare("start"))
     { 
+        bool aggregate = jCommand.contains("mode") && !jCommand["mode"].get<std::string>().compare("aggregate");
+        setMethodEntryAggregate(aggregate, getCommandOption(jCommand, "topN", 20), getCommandOption(jCommand, "interval", 10));
         error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_METHOD_ENTRY, (jthread)NULL);
         check_jvmti_error(jvmti, error, "Unable to enable MethodEntry event notifications.");
     }
@@ -207,13 +268,26 @@ void modifyMethodEntryEvents(const std::string& function, const std::string& com
     }
 }
 
-void modifyVerboseLogSubscriber(const std::string& function, const std::string& command, int sampleRate)
+void modifyVerboseLogSubscriber(const std::string& function, const std::string& command, int sampleRate, const json& jCommand)
 {
     /* enable stack trace */
     if (!command.compare("start"))
     {
+        std::string format = jCommand.value("format", std::string("structured"));
         verboseLogSubscriber = new VerboseLogSubscriber(jvmti);
         verboseLogSubscriber->setVerboseGCLogSampleRate(sampleRate);
+        if (!format.compare("raw"))
+        {
+            verboseLogSubscriber->setVerboseGCLogFormat(VERBOSE_LOG_FORMAT_RAW);
+        }
+        else if (!format.compare("both"))
+        {
+            verboseLogSubscriber->setVerboseGCLogFormat(VERBOSE_LOG_FORMAT_BOTH);
+        }
+        else
+        {
+            verboseLogSubscriber->setVerboseGCLogFormat(VERBOSE_LOG_FORMAT_STRUCTURED);
+        }
         verboseLogSubscriber->Subscribe();
     } else if (!command.compare("stop"))
     {
@@ -241,20 +315,109 @@ void modifyExceptionBackTrace(const std::string& function, const std::string& co
     }
 }
 
-void modifyExceptionEvents(const std::string& function, const std::string& command, int sampleRate)
+void modifyExceptionEvents(const std::string& function, const std::string& command, int sampleRate, const json& jCommand)
 {
     jvmtiError error;
     setExceptionSampleRate(sampleRate);
 
     if (!command.compare("start"))
     {
+        bool aggregate = jCommand.contains("mode") && !jCommand["mode"].get<std::string>().compare("aggregate");
+        setExceptionAggregate(aggregate, getCommandOption(jCommand, "detailLimit", 5),
+                              getCommandOption(jCommand, "topN", 20), getCommandOption(jCommand, "interval", 10));
+        setExceptionEventsEnabled(true);
         error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_EXCEPTION, (jthread)NULL);
         check_jvmti_error(jvmti, error, "Unable to enable Exception event notifications.");
     }
     else if (!command.compare("stop"))
     {
-        error = jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_EXCEPTION, (jthread)NULL);
-        check_jvmti_error(jvmti, error, "Unable to disable Exception event.");
+        setExceptionAggregate(false, 0, 0, 0);
+        setExceptionEventsEnabled(false);
+        /* unwind tracking still needs the throw events */
+        if (!isExceptionUnwindEnabled())
+        {
+            error = jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_EXCEPTION, (jthread)NULL);
+            check_jvmti_error(jvmti, error, "Unable to disable Exception event.");
+        }
+    }
+    else
+    {
+        invalidCommand(function, command);
+    }
+}
+
+void modifyExceptionUnwind(const std::string& function, const std::string& command, const json& jCommand)
+{
+    jvmtiError error;
+
+    if (!command.compare("start"))
+    {
+        setExceptionUnwind(true, getCommandOption(jCommand, "topN", 20), getCommandOption(jCommand, "interval", 10));
+        error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_EXCEPTION, (jthread)NULL);
+        check_jvmti_error(jvmti, error, "Unable to enable Exception event notifications.");
+        error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_EXCEPTION_CATCH, (jthread)NULL);
+        check_jvmti_error(jvmti, error, "Unable to enable ExceptionCatch event notifications.");
+    }
+    else if (!command.compare("stop"))
+    {
+        setExceptionUnwind(false, 0, 0);
+        error = jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_EXCEPTION_CATCH, (jthread)NULL);
+        check_jvmti_error(jvmti, error, "Unable to disable ExceptionCatch event.");
+        if (!isExceptionEventsEnabled())
+        {
+            error = jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_EXCEPTION, (jthread)NULL);
+            check_jvmti_error(jvmti, error, "Unable to disable Exception event.");
+        }
+    }
+    else
+    {
+        invalidCommand(function, command);
+    }
+}
+
+void modifyGCEvents(const std::string& function, const std::string& command, const json& jCommand)
+{
+    jvmtiError error;
+
+    if (!command.compare("start"))
+    {
+        setGCEvents(true, getCommandFlag(jCommand, "pauseEvents", false), getCommandOption(jCommand, "interval", 10));
+        error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_GARBAGE_COLLECTION_START, (jthread)NULL);
+        check_jvmti_error(jvmti, error, "Unable to enable GarbageCollectionStart event notifications.");
+        error = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_GARBAGE_COLLECTION_FINISH, (jthread)NULL);
+        check_jvmti_error(jvmti, error, "Unable to enable GarbageCollectionFinish event notifications.");
+    }
+    else if (!command.compare("stop"))
+    {
+        error = jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_GARBAGE_COLLECTION_START, (jthread)NULL);
+        check_jvmti_error(jvmti, error, "Unable to disable GarbageCollectionStart event.");
+        error = jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_GARBAGE_COLLECTION_FINISH, (jthread)NULL);
+        check_jvmti_error(jvmti, error, "Unable to disable GarbageCollectionFinish event.");
+        setGCEvents(false, false, 0);
+    }
+    else
+    {
+        invalidCommand(function, command);
+    }
+}
+
+void modifyHwCounters(const std::string& function, const std::string& command, const json& jCommand)
+{
+    if (!command.compare("start"))
+    {
+        std::vector<std::string> events = {"cycles", "instructions", "cache-references", "cache-misses", "branches", "branch-misses"};
+        if (jCommand.contains("events"))
+        {
+            events = jCommand["events"].get<std::vector<std::string>>();
+        }
+        if (!setHwCounters(true, events, getCommandOption(jCommand, "interval", 10)))
+        {
+            printf("hwCounters could not open any of the requested events\n");
+        }
+    }
+    else if (!command.compare("stop"))
+    {
+        setHwCounters(false, std::vector<std::string>(), 0);
     }
     else
     {
@@ -262,6 +425,73 @@ void modifyExceptionEvents(const std::string& function, const std::string& comma
     }
 }
 
+void modifyPerfMap(const std::string& function, const std::string& command)
+{
+    if (!command.compare("start"))
+    {
+        setPerfMap(true);
+    }
+    else if (!command.compare("stop"))
+    {
+        setPerfMap(false);
+    }
+    else
+    {
+        invalidCommand(function, command);
+    }
+}
+
+void modifyThreadFilter(const std::string& function, const std::string& command, const json& jCommand)
+{
+    if (!command.compare("start"))
+    {
+        std::vector<std::string> namePatterns, groupPatterns;
+        if (jCommand.contains("threadNames"))
+        {
+            namePatterns = jCommand["threadNames"].get<std::vector<std::string>>();
+        }
+        if (jCommand.contains("threadGroups"))
+        {
+            groupPatterns = jCommand["threadGroups"].get<std::vector<std::string>>();
+        }
+        try
+        {
+            setThreadFilter(namePatterns, groupPatterns);
+        }
+        catch (const std::regex_error& e)
+        {
+            printf("Invalid thread filter pattern: %s\n", e.what());
+        }
+    }
+    else if (!command.compare("stop"))
+    {
+        clearThreadFilter();
+    }
+    else
+    {
+        invalidCommand(function, command);
+    }
+}
+
+void modifyCallingContextTree(const std::string& function, const std::string& command, const json& jCommand)
+{
+    if (!command.compare("start"))
+    {
+        setCallingContextTree(true, getCommandOption(jCommand, "interval", 10));
+    }
+    else if (!command.compare("stop"))
+    {
+        setCallingContextTree(false, 0);
+    }
+    else if (!command.compare("report"))
+    {
+        requestCallingContextTree();
+    }
+    else
+    {
+        invalidCommand(function, command);
+    }
+}
 
 void agentCommand(const json& jCommand)
 {
@@ -270,7 +500,7 @@ void agentCommand(const json& jCommand)
     jvmtiPhase phase;
 
     std::string function = jCommand["functionality"].get<std::string>();
-    std::string command  = jCommand["command"].get<std::string>();
+    std::string command  = jCommand.value("command", std::string()); /* one-shot functionalities have no command */
     int sampleRate = 1; /* sampleRate is automatically set to 1. To turn off, set to 0 */
     if (jCommand.contains("sampleRate"))
     {
@@ -294,7 +524,7 @@ void agentCommand(const json& jCommand)
         }
         else if (!function.compare("objectAllocEvents"))
         {
-            modifyObjectAllocEvents(function, command, sampleRate);
+            modifyObjectAllocEvents(function, command, sampleRate, jCommand);
         }
         else if (!function.compare("monitorStackTrace"))
         {
@@ -302,15 +532,59 @@ void agentCommand(const json& jCommand)
         }
         else if (!function.compare("methodEntryEvents"))
         {
-            modifyMethodEntryEvents(function, command, sampleRate);
+            modifyMethodEntryEvents(function, command, sampleRate, jCommand);
         }
         else if (!function.compare("exceptionEvents"))
         {
-            modifyExceptionEvents(function, command, sampleRate);
+            modifyExceptionEvents(function, command, sampleRate, jCommand);
+        }
+        else if (!function.compare("exceptionUnwind"))
+        {
+            modifyExceptionUnwind(function, command, jCommand);
+        }
+        else if (!function.compare("gcEvents"))
+        {
+            modifyGCEvents(function, command, jCommand);
         }
         else if (!function.compare("verboseLog"))
         {
-            modifyVerboseLogSubscriber(function, command, sampleRate);
+            modifyVerboseLogSubscriber(function, command, sampleRate, jCommand);
+        }
+        else if (!function.compare("callingContextTree"))
+        {
+            modifyCallingContextTree(function, command, jCommand);
+        }
+        else if (!function.compare("heapHistogram"))
+        {
+            requestHeapHistogram(getCommandOption(jCommand, "topN", 20));
+        }
+        else if (!function.compare("heapDiff"))
+        {
+            requestHeapDiff(getCommandOption(jCommand, "topN", 20), getCommandOption(jCommand, "retain", HEAP_SNAPSHOTS_RETAINED_DEFAULT));
+        }
+        else if (!function.compare("retainedSize"))
+        {
+            requestRetainedSize(getCommandOption(jCommand, "topN", 20));
+        }
+        else if (!function.compare("heapWaste"))
+        {
+            requestHeapWaste(getCommandOption(jCommand, "topN", 20));
+        }
+        else if (!function.compare("heapSnapshot"))
+        {
+            requestHeapSnapshot(jCommand.value("file", "heapSnapshot-" + std::to_string(getpid()) + "-" + std::to_string(time(NULL)) + ".phs"));
+        }
+        else if (!function.compare("threadFilter"))
+        {
+            modifyThreadFilter(function, command, jCommand);
+        }
+        else if (!function.compare("hwCounters"))
+        {
+            modifyHwCounters(function, command, jCommand);
+        }
+        else if (!function.compare("perfMap"))
+        {
+            modifyPerfMap(function, command);
         }
         else
         {
@@ -0,0 +1,288 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <jvmti.h>
+#include <mutex>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#include "agentOptions.hpp"
+#include "callingContextTree.hpp"
+#include "infra.hpp"
+#include "json.hpp"
+#include "scheduler.hpp"
+#include "stacks.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+static const char *cctMetricNames[CCT_METRIC_MAX] = {"samples", "bytes", "contentions"};
+static const char *cctSelfMetricNames[CCT_METRIC_MAX] = {"selfSamples", "selfBytes", "selfContentions"};
+
+struct cct_node_t
+{
+    uint32_t parent;
+    bool exported;
+    jmethodID method;
+    jlocation location;
+    /* inclusive counters are the caller->callee edge weights, self counters belong to the leaf */
+    uint64_t total[CCT_METRIC_MAX];
+    uint64_t self[CCT_METRIC_MAX];
+    uint64_t exportedTotal[CCT_METRIC_MAX];
+    uint64_t exportedSelf[CCT_METRIC_MAX];
+};
+
+struct cct_edge_t
+{
+    uint32_t parent;
+    jmethodID method;
+    jlocation location;
+
+    bool operator==(const cct_edge_t& other) const
+    {
+        return parent == other.parent && method == other.method && location == other.location;
+    }
+};
+
+struct cct_edge_hash
+{
+    size_t operator()(const cct_edge_t& edge) const
+    {
+        uint64_t hash = ((uint64_t)(uintptr_t)edge.method * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)edge.location;
+        return (size_t)(hash ^ ((uint64_t)edge.parent << 32) ^ edge.parent);
+    }
+};
+
+atomic<bool> callingContextTreeEnabled {false};
+
+static mutex cctMutex;
+/* node 0 is the root. Stacks deeper than CCT_STACK_DEPTH keep their innermost frames under
+ * a child of the root with no method, so their outermost frame is never mistaken for a root */
+static vector<cct_node_t> cctNodes;
+static unordered_map<cct_edge_t, uint32_t, cct_edge_hash> cctChildren;
+static uint64_t cctTruncatedSamples = 0;
+
+static void resetCallingContextTree(void)
+{
+    cct_node_t root;
+    memset(&root, 0, sizeof(root));
+
+    cctNodes.clear();
+    cctChildren.clear();
+    cctNodes.push_back(root);
+    cctTruncatedSamples = 0;
+}
+
+static inline void addToNode(cct_node_t& node, cctMetric_t metric, uint64_t value, bool leaf)
+{
+    node.total[CCT_METRIC_SAMPLES]++;
+    if (metric != CCT_METRIC_SAMPLES)
+    {
+        node.total[metric] += value;
+    }
+    if (leaf)
+    {
+        node.self[CCT_METRIC_SAMPLES]++;
+        if (metric != CCT_METRIC_SAMPLES)
+        {
+            node.self[metric] += value;
+        }
+    }
+}
+
+void cctAddSample(jvmtiEnv *jvmtiEnv, jthread thread, cctMetric_t metric, uint64_t value)
+{
+    /* one more frame than kept tells whether the stack was cut */
+    jvmtiFrameInfo frames[CCT_STACK_DEPTH + 1];
+    jint count = 0;
+    jvmtiError err;
+
+    if (!callingContextTreeEnabled)
+    {
+        return;
+    }
+    err = jvmtiEnv->GetStackTrace(thread, 0, CCT_STACK_DEPTH + 1, frames, &count);
+    if (!check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Stack Trace.\n"))
+    {
+        return;
+    }
+    bool truncated = count > CCT_STACK_DEPTH;
+    if (truncated)
+    {
+        count = CCT_STACK_DEPTH;
+    }
+
+    lock_guard<mutex> lock(cctMutex);
+    uint32_t current = 0;
+    addToNode(cctNodes[0], metric, value, count == 0);
+
+    /* walk from the outermost frame down, sharing every prefix already in the tree */
+    for (jint i = truncated ? count : count - 1; i >= 0; i--)
+    {
+        /* i == count stands for the <truncated> node */
+        jmethodID method = (i == count) ? NULL : frames[i].method;
+        jlocation location = (i == count) ? -1 : frames[i].location;
+        cct_edge_t edge = {current, method, location};
+        auto child = cctChildren.find(edge);
+        if (child != cctChildren.end())
+        {
+            current = child->second;
+        }
+        else if (cctNodes.size() < CCT_MAX_NODES)
+        {
+            cct_node_t node;
+            memset(&node, 0, sizeof(node));
+            node.parent = current;
+            node.method = method;
+            node.location = location;
+            current = (uint32_t)cctNodes.size();
+            cctNodes.push_back(node);
+            cctChildren[edge] = current;
+        }
+        else
+        {
+            /* tree is full, charge the sample to the deepest context it already has */
+            cctTruncatedSamples++;
+            cctNodes[current].self[CCT_METRIC_SAMPLES]++;
+            if (metric != CCT_METRIC_SAMPLES)
+            {
+                cctNodes[current].self[metric] += value;
+            }
+            return;
+        }
+        addToNode(cctNodes[current], metric, value, i == 0);
+    }
+}
+
+/* Sends either every node or only the nodes that changed since the last delta.
+ * Methods are listed once and referenced by index from the nodes. */
+static void exportCallingContextTree(jvmtiEnv *jvmtiEnv, bool deltaOnly)
+{
+    vector<uint32_t> ids;
+    vector<cct_node_t> nodes;
+    uint64_t truncatedSamples;
+
+    /* copy the changed nodes out, names are resolved without holding the lock */
+    {
+        lock_guard<mutex> lock(cctMutex);
+        for (uint32_t id = 0; id < cctNodes.size(); id++)
+        {
+            cct_node_t& node = cctNodes[id];
+            if (deltaOnly && node.exported
+                && !memcmp(node.total, node.exportedTotal, sizeof(node.total))
+                && !memcmp(node.self, node.exportedSelf, sizeof(node.self)))
+            {
+                continue;
+            }
+            ids.push_back(id);
+            nodes.push_back(node);
+            if (deltaOnly)
+            {
+                node.exported = true;
+                memcpy(node.exportedTotal, node.total, sizeof(node.total));
+                memcpy(node.exportedSelf, node.self, sizeof(node.self));
+            }
+        }
+        truncatedSamples = cctTruncatedSamples;
+    }
+
+    unordered_map<jmethodID, size_t> methodIndex;
+    auto jMethods = json::array();
+    auto jNodes = json::array();
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        cct_node_t& node = nodes[i];
+        json jNode;
+        jNode["id"] = ids[i];
+
+        /* a delta only repeats the frame of nodes the consumer has not seen yet */
+        if (ids[i] != 0 && (!deltaOnly || !node.exported) && node.method == NULL)
+        {
+            jNode["parent"] = node.parent;
+            jNode["truncated"] = true;
+        }
+        else if (ids[i] != 0 && (!deltaOnly || !node.exported))
+        {
+            auto method = methodIndex.find(node.method);
+            if (method == methodIndex.end())
+            {
+                json jMethod = describeFrame(jvmtiEnv, node.method, 0);
+                jMethod.erase("methodLineNum");
+                method = methodIndex.emplace(node.method, jMethods.size()).first;
+                jMethods.push_back(jMethod);
+            }
+            jNode["parent"] = node.parent;
+            jNode["method"] = method->second;
+            jNode["methodLineNum"] = getLineNumber(jvmtiEnv, node.method, node.location);
+        }
+
+        for (int metric = 0; metric < CCT_METRIC_MAX; metric++)
+        {
+            uint64_t total = node.total[metric] - (deltaOnly ? node.exportedTotal[metric] : 0);
+            uint64_t self = node.self[metric] - (deltaOnly ? node.exportedSelf[metric] : 0);
+            if (total != 0)
+            {
+                jNode[cctMetricNames[metric]] = total;
+            }
+            if (self != 0)
+            {
+                jNode[cctSelfMetricNames[metric]] = self;
+            }
+        }
+        jNodes.push_back(jNode);
+    }
+
+    json j;
+    j["callingContextTree"]["delta"] = deltaOnly;
+    j["callingContextTree"]["truncatedSamples"] = truncatedSamples;
+    j["callingContextTree"]["methods"] = jMethods;
+    j["callingContextTree"]["nodes"] = jNodes;
+    sendToServer(j.dump());
+}
+
+void setCallingContextTree(bool enabled, int intervalSeconds)
+{
+    if (enabled)
+    {
+        {
+            lock_guard<mutex> lock(cctMutex);
+            resetCallingContextTree();
+        }
+        callingContextTreeEnabled = true;
+        schedulePeriodicTask("callingContextTree", intervalSeconds, [](jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv) {
+            exportCallingContextTree(jvmtiEnv, true);
+        });
+    }
+    else if (callingContextTreeEnabled)
+    {
+        callingContextTreeEnabled = false;
+        cancelPeriodicTask("callingContextTree");
+    }
+}
+
+void requestCallingContextTree(void)
+{
+    submitTask([](jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv) {
+        exportCallingContextTree(jvmtiEnv, false);
+    });
+}
@@ -0,0 +1,98 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <jvmti.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "classTags.hpp"
+#include "infra.hpp"
+
+using namespace std;
+
+static mutex classTagsMutex;
+static vector<string> classTagNames;
+
+jlong getClassTag(jvmtiEnv *jvmtiEnv, jclass klass)
+{
+    jvmtiError err;
+    jlong tag = 0;
+    char *classSignature;
+
+    err = jvmtiEnv->GetTag(klass, &tag);
+    if (!check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Class Tag.\n"))
+    {
+        return 0;
+    }
+    if (tag != 0)
+    {
+        return tag;
+    }
+
+    /* first time this class is seen, check again under the lock to not tag it twice */
+    lock_guard<mutex> lock(classTagsMutex);
+    err = jvmtiEnv->GetTag(klass, &tag);
+    if (err != JVMTI_ERROR_NONE || tag != 0)
+    {
+        return tag;
+    }
+    if ((jlong)classTagNames.size() >= CLASS_TAG_MAX)
+    {
+        return 0;
+    }
+
+    err = jvmtiEnv->GetClassSignature(klass, &classSignature, NULL);
+    if (!check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Class Signature.\n"))
+    {
+        return 0;
+    }
+    tag = (jlong)classTagNames.size() + 1;
+    err = jvmtiEnv->SetTag(klass, tag);
+    if (check_jvmti_error(jvmtiEnv, err, "Unable to set Class Tag.\n"))
+    {
+        classTagNames.push_back(classSignature);
+    }
+    else
+    {
+        tag = 0;
+    }
+    jvmtiEnv->Deallocate((unsigned char*)classSignature);
+
+    return tag;
+}
+
+string getClassTagName(jlong tag)
+{
+    lock_guard<mutex> lock(classTagsMutex);
+    if (tag <= 0 || tag > (jlong)classTagNames.size())
+    {
+        return "unknown";
+    }
+    return classTagNames[tag - 1];
+}
+
+jlong getClassTagCount(void)
+{
+    lock_guard<mutex> lock(classTagsMutex);
+    return (jlong)classTagNames.size();
+}
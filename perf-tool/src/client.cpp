@@ -30,6 +30,7 @@
 #include <netinet/in.h>
 #include <netdb.h>
 
+#include "heapSnapshot.hpp"
 #include "utils.hpp"
 
 #define POLL_INTERVAL 150
@@ -168,6 +169,22 @@ int main(int argc, char const *argv[])
     string hostname = "localhost";
     int portno = 9003;
 
+    if (argc >= 3 && !strcmp(argv[1], "--decode-snapshot"))
+    {
+        /* convert a heapSnapshot file to JSON lines instead of connecting to the agent */
+        FILE *out = (argc >= 4) ? fopen(argv[3], "w") : stdout;
+        if (out == NULL)
+        {
+            error("ERROR opening output file");
+        }
+        bool decoded = decodeHeapSnapshot(argv[2], out);
+        if (out != stdout)
+        {
+            fclose(out);
+        }
+        return decoded ? 0 : 1;
+    }
+
     if (argc > 2)
     {
         hostname = argv[1];
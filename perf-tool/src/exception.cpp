@@ -20,14 +20,25 @@
  * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
  *******************************************************************************/
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <jvmti.h>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "agentOptions.hpp"
+#include "callingContextTree.hpp"
+#include "classTags.hpp"
 #include "infra.hpp"
 #include "json.hpp"
 #include "exception.hpp"
+#include "scheduler.hpp"
+#include "shardedTable.hpp"
+#include "stacks.hpp"
+#include "threads.hpp"
 
 using namespace std;
 using json = nlohmann::json;
@@ -35,6 +46,329 @@ using json = nlohmann::json;
 atomic<bool> backTraceEnabled {true};
 atomic<int> exceptionSampleCount {0};
 atomic<int> exceptionSampleRate {1};
+atomic<bool> exceptionAggregateEnabled {false};
+atomic<int> exceptionDetailLimit {5};
+
+struct exception_site_t
+{
+    jlong classTag;
+    jmethodID method;
+    jlocation location;
+
+    bool operator==(const exception_site_t& other) const
+    {
+        return classTag == other.classTag && method == other.method && location == other.location;
+    }
+};
+
+struct exception_site_hash
+{
+    size_t operator()(const exception_site_t& site) const
+    {
+        uint64_t hash = ((uint64_t)(uintptr_t)site.method * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)site.location;
+        return (size_t)(hash ^ ((uint64_t)site.classTag * 0xff51afd7ed558ccdULL));
+    }
+};
+
+/* sites are spread over independently locked shards so throwing threads rarely contend */
+static ShardedTable<exception_site_t, uint64_t, exception_site_hash> exceptionSites;
+/* only used by the scheduler thread */
+static unordered_map<exception_site_t, uint64_t, exception_site_hash> previousExceptionSites;
+static chrono::steady_clock::time_point previousExceptionSummary;
+static int exceptionSummaryTopN = 20;
+
+atomic<bool> exceptionEventsEnabled {false};
+atomic<bool> exceptionUnwindEnabled {false};
+
+struct unwind_stats_t
+{
+    uint64_t count;
+    uint64_t frames;
+    uint64_t maxFrames;
+    uint64_t nanos;
+    uint64_t maxNanos;
+
+    void add(uint64_t unwoundFrames, uint64_t unwindNanos)
+    {
+        count++;
+        frames += unwoundFrames;
+        maxFrames = max(maxFrames, unwoundFrames);
+        nanos += unwindNanos;
+        maxNanos = max(maxNanos, unwindNanos);
+    }
+};
+
+struct unwind_site_t
+{
+    jlong classTag;
+    jmethodID throwMethod;
+    jlocation throwLocation;
+    jmethodID catchMethod;
+    jlocation catchLocation;
+
+    bool operator==(const unwind_site_t& other) const
+    {
+        return classTag == other.classTag && throwMethod == other.throwMethod && throwLocation == other.throwLocation
+            && catchMethod == other.catchMethod && catchLocation == other.catchLocation;
+    }
+};
+
+struct unwind_site_hash
+{
+    size_t operator()(const unwind_site_t& site) const
+    {
+        size_t hash = exception_site_hash()({site.classTag, site.throwMethod, site.throwLocation});
+        return hash ^ exception_site_hash()({0, site.catchMethod, site.catchLocation}) * 31;
+    }
+};
+
+/* the exception in flight on this thread, set when thrown and cleared when caught */
+struct pending_throw_t
+{
+    bool active;
+    jlong classTag;
+    jmethodID method;
+    jlocation location;
+    jint depth;
+    jweak exception;    /* to tell the catch of this exception from a catch of another one */
+    chrono::steady_clock::time_point thrown;
+};
+
+static thread_local pending_throw_t pendingThrow;
+static ShardedTable<jlong, unwind_stats_t, hash<jlong>> unwindByType;
+static ShardedTable<unwind_site_t, unwind_stats_t, unwind_site_hash> unwindBySite;
+static int exceptionUnwindTopN = 20;
+
+static json unwindStatsToJson(const unwind_stats_t& stats)
+{
+    json jStats;
+    jStats["count"] = stats.count;
+    jStats["avgFrames"] = stats.count > 0 ? (double)stats.frames / stats.count : 0.0;
+    jStats["maxFrames"] = stats.maxFrames;
+    jStats["avgMicros"] = stats.count > 0 ? stats.nanos / 1000.0 / stats.count : 0.0;
+    jStats["maxMicros"] = stats.maxNanos / 1000.0;
+    jStats["totalMicros"] = stats.nanos / 1000.0;
+    return jStats;
+}
+
+/* Sends unwind depth and latency per exception type, and for the most expensive throw and catch site pairs */
+static void reportExceptionUnwind(jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv)
+{
+    auto types = unwindByType.snapshot();
+    auto sites = unwindBySite.snapshot();
+
+    auto jTypes = json::array();
+    for (auto& entry : types)
+    {
+        json jType = unwindStatsToJson(entry.second);
+        jType["exceptionType"] = getClassTagName(entry.first);
+        jTypes.push_back(jType);
+    }
+
+    vector<pair<unwind_site_t, unwind_stats_t>> sorted(sites.begin(), sites.end());
+    size_t n = min((size_t)exceptionUnwindTopN, sorted.size());
+    partial_sort(sorted.begin(), sorted.begin() + n, sorted.end(),
+        [](const pair<unwind_site_t, unwind_stats_t>& a, const pair<unwind_site_t, unwind_stats_t>& b) {
+            return a.second.nanos > b.second.nanos;
+        });
+    auto jSites = json::array();
+    for (size_t i = 0; i < n; i++)
+    {
+        json jSite = unwindStatsToJson(sorted[i].second);
+        jSite["exceptionType"] = getClassTagName(sorted[i].first.classTag);
+        jSite["throw"] = describeFrame(jvmtiEnv, sorted[i].first.throwMethod, sorted[i].first.throwLocation);
+        jSite["catch"] = describeFrame(jvmtiEnv, sorted[i].first.catchMethod, sorted[i].first.catchLocation);
+        jSites.push_back(jSite);
+    }
+
+    json j;
+    j["exceptionUnwind"]["types"] = jTypes;
+    j["exceptionUnwind"]["sites"] = jSites;
+    sendToServer(j.dump());
+}
+
+void setExceptionEventsEnabled(bool enabled) {
+    exceptionEventsEnabled = enabled;
+}
+
+bool isExceptionEventsEnabled(void) {
+    return exceptionEventsEnabled;
+}
+
+void setExceptionUnwind(bool enabled, int topN, int intervalSeconds) {
+    if (enabled) {
+        unwindByType.clear();
+        unwindBySite.clear();
+        exceptionUnwindTopN = topN;
+        exceptionUnwindEnabled = true;
+        schedulePeriodicTask("exceptionUnwind", intervalSeconds, &reportExceptionUnwind);
+    } else if (exceptionUnwindEnabled) {
+        exceptionUnwindEnabled = false;
+        cancelPeriodicTask("exceptionUnwind");
+    }
+}
+
+bool isExceptionUnwindEnabled(void) {
+    return exceptionUnwindEnabled;
+}
+
+void releasePendingThrow(JNIEnv* jniEnv) {
+    pendingThrow.active = false;
+    if (pendingThrow.exception != NULL) {
+        jniEnv->DeleteWeakGlobalRef(pendingThrow.exception);
+        pendingThrow.exception = NULL;
+    }
+}
+
+/* Remembers where the exception was thrown and how deep the stack was. The throw time is
+ * set by throw_timestamp_t when the Exception callback returns. */
+static void recordExceptionThrow(jvmtiEnv *jvmtiEnv, JNIEnv* jniEnv, jthread thread,
+            jmethodID method, jlocation location, jobject exception) {
+    jvmtiError err;
+    jclass exceptionClass;
+
+    releasePendingThrow(jniEnv);
+    err = jvmtiEnv->GetFrameCount(thread, &pendingThrow.depth);
+    if (!check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Frame Count.\n")) {
+        return;
+    }
+    exceptionClass = jniEnv->GetObjectClass(exception);
+    pendingThrow.classTag = getClassTag(jvmtiEnv, exceptionClass);
+    jniEnv->DeleteLocalRef(exceptionClass);
+    pendingThrow.method = method;
+    pendingThrow.location = location;
+    pendingThrow.exception = jniEnv->NewWeakGlobalRef(exception);
+    pendingThrow.active = (pendingThrow.exception != NULL);
+}
+
+/* Stamps the pending throw when the Exception callback returns, so the agent's own work
+ * in the callback is not counted as unwind time */
+struct throw_timestamp_t
+{
+    ~throw_timestamp_t()
+    {
+        if (pendingThrow.active) {
+            pendingThrow.thrown = chrono::steady_clock::now();
+        }
+    }
+};
+
+JNIEXPORT void JNICALL ExceptionCatch(jvmtiEnv *jvmtiEnv,
+            JNIEnv* jniEnv,
+            jthread thread,
+            jmethodID method,
+            jlocation location,
+            jobject exception) {
+    jvmtiError err;
+    jint depth;
+
+    if (!pendingThrow.active) {
+        return;
+    }
+    uint64_t nanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - pendingThrow.thrown).count();
+
+    /* a throw caught in native code or cleared by a JNI frame posts no catch, drop it */
+    bool sameException = jniEnv->IsSameObject(pendingThrow.exception, exception);
+    releasePendingThrow(jniEnv);
+    if (!sameException) {
+        return;
+    }
+
+    err = jvmtiEnv->GetFrameCount(thread, &depth);
+    if (!check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Frame Count.\n")) {
+        return;
+    }
+    uint64_t frames = pendingThrow.depth > depth ? pendingThrow.depth - depth : 0;
+
+    unwindByType.update(pendingThrow.classTag, [=](unwind_stats_t& stats) { stats.add(frames, nanos); });
+    unwind_site_t site = {pendingThrow.classTag, pendingThrow.method, pendingThrow.location, method, location};
+    unwindBySite.update(site, [=](unwind_stats_t& stats) { stats.add(frames, nanos); });
+}
+
+/* Sends exception counts and rates per exception type and per throw site */
+static void reportExceptionSummary(jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv)
+{
+    struct site_count_t
+    {
+        exception_site_t site;
+        uint64_t count;
+        uint64_t intervalCount;
+    };
+    vector<site_count_t> sites;
+    unordered_map<jlong, pair<uint64_t, uint64_t>> types;
+    unordered_map<exception_site_t, uint64_t, exception_site_hash> current = exceptionSites.snapshot();
+    uint64_t totalExceptions = 0, intervalExceptions = 0;
+
+    auto now = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(now - previousExceptionSummary).count();
+    previousExceptionSummary = now;
+
+    for (auto& entry : current)
+    {
+        auto previous = previousExceptionSites.find(entry.first);
+        uint64_t intervalCount = entry.second - (previous != previousExceptionSites.end() ? previous->second : 0);
+        sites.push_back({entry.first, entry.second, intervalCount});
+        types[entry.first.classTag].first += entry.second;
+        types[entry.first.classTag].second += intervalCount;
+        totalExceptions += entry.second;
+        intervalExceptions += intervalCount;
+    }
+    previousExceptionSites.swap(current);
+
+    auto jTypes = json::array();
+    for (auto& entry : types)
+    {
+        json jType;
+        jType["exceptionType"] = getClassTagName(entry.first);
+        jType["count"] = entry.second.first;
+        jType["intervalCount"] = entry.second.second;
+        jType["rate"] = seconds > 0 ? entry.second.second / seconds : 0.0;
+        jTypes.push_back(jType);
+    }
+
+    /* the busiest sites of this interval first */
+    size_t n = min((size_t)exceptionSummaryTopN, sites.size());
+    partial_sort(sites.begin(), sites.begin() + n, sites.end(),
+        [](const site_count_t& a, const site_count_t& b) {
+            return a.intervalCount > b.intervalCount || (a.intervalCount == b.intervalCount && a.count > b.count);
+        });
+    auto jSites = json::array();
+    for (size_t i = 0; i < n; i++)
+    {
+        json jSite = describeFrame(jvmtiEnv, sites[i].site.method, sites[i].site.location);
+        jSite["exceptionType"] = getClassTagName(sites[i].site.classTag);
+        jSite["location"] = sites[i].site.location;
+        jSite["count"] = sites[i].count;
+        jSite["intervalCount"] = sites[i].intervalCount;
+        jSite["rate"] = seconds > 0 ? sites[i].intervalCount / seconds : 0.0;
+        jSites.push_back(jSite);
+    }
+
+    json j;
+    j["exceptionSummary"]["intervalSeconds"] = seconds;
+    j["exceptionSummary"]["totalExceptions"] = totalExceptions;
+    j["exceptionSummary"]["intervalExceptions"] = intervalExceptions;
+    j["exceptionSummary"]["types"] = jTypes;
+    j["exceptionSummary"]["sites"] = jSites;
+    sendToServer(j.dump());
+}
+
+void setExceptionAggregate(bool enabled, int detailLimit, int topN, int intervalSeconds) {
+    if (enabled) {
+        exceptionSites.clear();
+        exceptionDetailLimit = detailLimit;
+        exceptionSummaryTopN = topN;
+        submitTask([](jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv) {
+            previousExceptionSites.clear();
+            previousExceptionSummary = chrono::steady_clock::now();
+        });
+        exceptionAggregateEnabled = true;
+        schedulePeriodicTask("exceptionSummary", intervalSeconds, &reportExceptionSummary);
+    } else if (exceptionAggregateEnabled) {
+        exceptionAggregateEnabled = false;
+        cancelPeriodicTask("exceptionSummary");
+    }
+}
 
 
 void setExceptionSampleRate(int rate) {
@@ -73,8 +407,43 @@ JNIEXPORT void JNICALL Exception(jvmtiEnv *jvmtiEnv,
     char *methodName;
     int numExceptions;
 
+    bool sampled;
+
+    if (isThreadFiltered(jvmtiEnv, jniEnv, thread)) {
+        return;
+    }
+
+    throw_timestamp_t throwTimestamp;
+    if (exceptionUnwindEnabled) {
+        recordExceptionThrow(jvmtiEnv, jniEnv, thread, method, location, exception);
+    }
+    if (!exceptionEventsEnabled) {
+        return;
+    }
+
     /* Get number of exceptions recorded and increment */
     numExceptions = atomic_fetch_add(&exceptionSampleCount, 1);
+    sampled = (numExceptions % exceptionSampleRate == 0);
+
+    if (exceptionAggregateEnabled) {
+        /* cheap path: count the site, and only resolve details for its first few throws or when sampled */
+        exception_site_t site;
+        jclass exceptionClass = jniEnv->GetObjectClass(exception);
+        site.classTag = getClassTag(jvmtiEnv, exceptionClass);
+        site.method = method;
+        site.location = location;
+        jniEnv->DeleteLocalRef(exceptionClass);
+
+        uint64_t siteCount = exceptionSites.update(site, [](uint64_t& count) { return ++count; });
+        if (siteCount <= (uint64_t)exceptionDetailLimit) {
+            sampled = true;
+        } else if (!sampled || !backTraceEnabled) {
+            return;
+        }
+        jdata["exceptionType"] = getClassTagName(site.classTag);
+        jdata["siteCount"] = siteCount;
+    }
+
     jdata["numExceptions"] = numExceptions;
 
     /* Get exception address */
@@ -122,7 +491,7 @@ JNIEXPORT void JNICALL Exception(jvmtiEnv *jvmtiEnv,
 
     // Get information from stack
     if (backTraceEnabled) { // only run when backtrace is enabled
-        if (numExceptions % exceptionSampleRate == 0) {
+        if (sampled) {
             jvmtiFrameInfo frames[EXCEPTION_STACK_TRACE_NUM_FRAMES];
             jint count;
             auto jMethods = json::array();
@@ -130,6 +499,7 @@ JNIEXPORT void JNICALL Exception(jvmtiEnv *jvmtiEnv,
             err = jvmtiEnv->GetStackTrace(thread, 0, EXCEPTION_STACK_TRACE_NUM_FRAMES,
                                         frames, &count);
             if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Stack Trace.\n") && count >= 1) {
+                cctAddSample(jvmtiEnv, thread, CCT_METRIC_SAMPLES, 1);
                 json jMethod;
                 for (int i = 0; i < count; i++) {
                     /* Get method name */
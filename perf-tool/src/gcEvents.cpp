@@ -0,0 +1,247 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <atomic>
+#include <jvmti.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "agentOptions.hpp"
+#include "gcEvents.hpp"
+#include "infra.hpp"
+#include "json.hpp"
+#include "scheduler.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+struct gc_pause_t
+{
+    uint64_t startNanos;
+    uint64_t endNanos;
+};
+
+/* ring slots are atomic so the reporter can copy a slot while the GC callback overwrites it */
+struct gc_pause_slot_t
+{
+    atomic<uint64_t> startNanos;
+    atomic<uint64_t> endNanos;
+};
+
+atomic<bool> gcEventsEnabled {false};
+atomic<bool> gcPauseEventsEnabled {false};
+
+/* written by the GC callbacks */
+static atomic<uint64_t> gcStartNanos {0};
+static atomic<uint64_t> gcPreviousStartNanos {0};
+static atomic<uint64_t> gcCount {0};
+static atomic<uint64_t> gcTotalPauseNanos {0};
+static atomic<uint64_t> gcMaxPauseNanos {0};
+static atomic<uint64_t> gcTotalIntervalNanos {0};
+static atomic<uint64_t> gcIntervals {0};
+static atomic<uint64_t> gcPauseHistogram[GC_PAUSE_HISTOGRAM_BUCKETS];
+
+/* single producer ring of pauses: the GC callbacks never run concurrently with each other */
+static gc_pause_slot_t gcPauseRing[GC_PAUSE_RING_SIZE];
+static atomic<uint64_t> gcPauseRingWrite {0};
+
+/* only used by the scheduler thread */
+static uint64_t gcPauseRingRead = 0;
+static uint64_t previousGCCount = 0;
+static uint64_t previousGCTotalPauseNanos = 0;
+static uint64_t previousGCTotalIntervalNanos = 0;
+static uint64_t previousGCIntervals = 0;
+static uint64_t previousGCPauseHistogram[GC_PAUSE_HISTOGRAM_BUCKETS];
+static uint64_t previousGCReportNanos = 0;
+
+static inline uint64_t monotonicNanos(void)
+{
+    /* clock_gettime is async-signal-safe, unlike most of the standard library */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static inline int pauseBucket(uint64_t pauseNanos)
+{
+    uint64_t micros = pauseNanos / 1000;
+    int bucket = 0;
+    while (micros > 1 && bucket < GC_PAUSE_HISTOGRAM_BUCKETS - 1)
+    {
+        micros >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+JNIEXPORT void JNICALL GarbageCollectionStart(jvmtiEnv *jvmtiEnv)
+{
+    uint64_t now = monotonicNanos();
+    uint64_t previousStart = gcPreviousStartNanos.exchange(now, memory_order_relaxed);
+
+    if (previousStart != 0)
+    {
+        gcTotalIntervalNanos.fetch_add(now - previousStart, memory_order_relaxed);
+        gcIntervals.fetch_add(1, memory_order_relaxed);
+    }
+    gcStartNanos.store(now, memory_order_relaxed);
+}
+
+JNIEXPORT void JNICALL GarbageCollectionFinish(jvmtiEnv *jvmtiEnv)
+{
+    uint64_t now = monotonicNanos();
+    uint64_t start = gcStartNanos.load(memory_order_relaxed);
+    uint64_t pause, max;
+
+    if (start == 0 || now < start)
+    {
+        /* enabled in the middle of a collection */
+        return;
+    }
+    pause = now - start;
+
+    gcPauseHistogram[pauseBucket(pause)].fetch_add(1, memory_order_relaxed);
+    gcTotalPauseNanos.fetch_add(pause, memory_order_relaxed);
+    max = gcMaxPauseNanos.load(memory_order_relaxed);
+    while (pause > max && !gcMaxPauseNanos.compare_exchange_weak(max, pause, memory_order_relaxed))
+    {
+    }
+
+    if (gcPauseEventsEnabled)
+    {
+        uint64_t write = gcPauseRingWrite.load(memory_order_relaxed);
+        gc_pause_slot_t& slot = gcPauseRing[write % GC_PAUSE_RING_SIZE];
+        /* a reader that sees any part of this slot also sees the write index of the previous pause */
+        atomic_thread_fence(memory_order_release);
+        slot.startNanos.store(start, memory_order_relaxed);
+        slot.endNanos.store(now, memory_order_relaxed);
+        gcPauseRingWrite.store(write + 1, memory_order_release);
+    }
+    gcCount.fetch_add(1, memory_order_release);
+}
+
+/* Sends the pauses since the previous report, and a summary of pause times and GC frequency */
+static void reportGCEvents(jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv)
+{
+    uint64_t now = monotonicNanos();
+    uint64_t count = gcCount.load(memory_order_acquire);
+    uint64_t totalPauseNanos = gcTotalPauseNanos.load(memory_order_relaxed);
+    uint64_t totalIntervalNanos = gcTotalIntervalNanos.load(memory_order_relaxed);
+    uint64_t intervals = gcIntervals.load(memory_order_relaxed);
+    double seconds = (now - previousGCReportNanos) / 1e9;
+
+    if (gcPauseEventsEnabled)
+    {
+        uint64_t write = gcPauseRingWrite.load(memory_order_acquire);
+        uint64_t dropped = 0;
+        if (write - gcPauseRingRead > GC_PAUSE_RING_SIZE)
+        {
+            dropped = write - gcPauseRingRead - GC_PAUSE_RING_SIZE;
+            gcPauseRingRead = write - GC_PAUSE_RING_SIZE;
+        }
+        for (; gcPauseRingRead < write; gcPauseRingRead++)
+        {
+            const gc_pause_slot_t& slot = gcPauseRing[gcPauseRingRead % GC_PAUSE_RING_SIZE];
+            gc_pause_t pause = {slot.startNanos.load(memory_order_relaxed), slot.endNanos.load(memory_order_relaxed)};
+            /* the GC callbacks keep running while the pauses are sent: once the writer
+             * has reached the next lap of this slot the copy may be torn */
+            atomic_thread_fence(memory_order_acquire);
+            if (gcPauseRingWrite.load(memory_order_relaxed) - gcPauseRingRead >= GC_PAUSE_RING_SIZE)
+            {
+                dropped++;
+                continue;
+            }
+            json jPause;
+            jPause["gcPause"]["startNanos"] = pause.startNanos;
+            jPause["gcPause"]["pauseMicros"] = (pause.endNanos - pause.startNanos) / 1000.0;
+            sendToServer(jPause.dump());
+        }
+        if (dropped > 0)
+        {
+            json jDropped;
+            jDropped["gcPausesDropped"] = dropped;
+            sendToServer(jDropped.dump());
+        }
+    }
+
+    json jSummary;
+    uint64_t intervalCount = count - previousGCCount;
+    uint64_t intervalPauseNanos = totalPauseNanos - previousGCTotalPauseNanos;
+    uint64_t intervalGaps = intervals - previousGCIntervals;
+    jSummary["intervalSeconds"] = seconds;
+    jSummary["gcCount"] = intervalCount;
+    jSummary["gcPerSecond"] = seconds > 0 ? intervalCount / seconds : 0.0;
+    jSummary["totalPauseMicros"] = intervalPauseNanos / 1000.0;
+    jSummary["avgPauseMicros"] = intervalCount > 0 ? intervalPauseNanos / 1000.0 / intervalCount : 0.0;
+    jSummary["maxPauseMicros"] = gcMaxPauseNanos.exchange(0, memory_order_relaxed) / 1000.0;
+    jSummary["pausePercent"] = seconds > 0 ? intervalPauseNanos / 1e9 / seconds * 100 : 0.0;
+    jSummary["avgMicrosBetweenGCs"] = intervalGaps > 0 ? (totalIntervalNanos - previousGCTotalIntervalNanos) / 1000.0 / intervalGaps : 0.0;
+    jSummary["totalGCCount"] = count;
+
+    /* bucket i counts pauses of [2^i, 2^(i+1)) microseconds, only non empty buckets are sent */
+    auto jHistogram = json::array();
+    for (int i = 0; i < GC_PAUSE_HISTOGRAM_BUCKETS; i++)
+    {
+        uint64_t bucket = gcPauseHistogram[i].load(memory_order_relaxed);
+        if (bucket != previousGCPauseHistogram[i])
+        {
+            json jBucket;
+            jBucket["minMicros"] = i == 0 ? 0 : (1ULL << i);
+            jBucket["count"] = bucket - previousGCPauseHistogram[i];
+            jHistogram.push_back(jBucket);
+        }
+        previousGCPauseHistogram[i] = bucket;
+    }
+    jSummary["pauseHistogram"] = jHistogram;
+
+    previousGCCount = count;
+    previousGCTotalPauseNanos = totalPauseNanos;
+    previousGCTotalIntervalNanos = totalIntervalNanos;
+    previousGCIntervals = intervals;
+    previousGCReportNanos = now;
+
+    json j;
+    j["gcSummary"] = jSummary;
+    sendToServer(j.dump());
+}
+
+void setGCEvents(bool enabled, bool pauseEvents, int intervalSeconds)
+{
+    if (enabled)
+    {
+        gcPauseEventsEnabled = pauseEvents;
+        gcStartNanos = 0;
+        gcPreviousStartNanos = 0;
+        submitTask([](jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv) {
+            /* only report what happens from now on */
+            gcPauseRingRead = gcPauseRingWrite.load(memory_order_acquire);
+            previousGCReportNanos = monotonicNanos();
+        });
+        gcEventsEnabled = true;
+        schedulePeriodicTask("gcEvents", intervalSeconds, &reportGCEvents);
+    }
+    else if (gcEventsEnabled)
+    {
+        gcEventsEnabled = false;
+        cancelPeriodicTask("gcEvents");
+    }
+}
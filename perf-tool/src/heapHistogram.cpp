@@ -0,0 +1,309 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <jvmti.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "agentOptions.hpp"
+#include "classTags.hpp"
+#include "heapHistogram.hpp"
+#include "infra.hpp"
+#include "json.hpp"
+#include "scheduler.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+/* Histograms are kept sparse, sorted by tag, since most classes have no instances */
+struct heap_snapshot_entry_t
+{
+    uint32_t tag;
+    jlong instances;
+    jlong bytes;
+};
+
+struct heap_snapshot_t
+{
+    chrono::steady_clock::time_point time;
+    jlong totalInstances;
+    jlong totalBytes;
+    vector<heap_snapshot_entry_t> entries;
+};
+
+/* only used by the scheduler thread */
+static deque<heap_snapshot_t> heapSnapshots;
+static size_t heapSnapshotsRetained = HEAP_SNAPSHOTS_RETAINED_DEFAULT;
+
+static jint JNICALL heapHistogramCallback(jlong classTag, jlong size, jlong *tagPtr, jint length, void *userData)
+{
+    heap_histogram_t *histogram = (heap_histogram_t *)userData;
+
+    /* runs once per object with the VM stopped, so keep it to a bounds check and two adds */
+    if (classTag > 0 && classTag < (jlong)histogram->instances.size())
+    {
+        histogram->instances[classTag]++;
+        histogram->bytes[classTag] += size;
+    }
+    else
+    {
+        histogram->untaggedInstances++;
+    }
+    histogram->totalInstances++;
+    histogram->totalBytes += size;
+
+    return JVMTI_VISIT_OBJECTS;
+}
+
+bool collectHeapHistogram(jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv, heap_histogram_t& histogram)
+{
+    jvmtiError err;
+    jint classCount = 0;
+    jclass *classes = NULL;
+    jvmtiHeapCallbacks callbacks;
+
+    err = jvmtiEnv->GetLoadedClasses(&classCount, &classes);
+    if (!check_jvmti_error(jvmtiEnv, err, "Unable to get loaded classes.\n"))
+    {
+        return false;
+    }
+    for (jint i = 0; i < classCount; i++)
+    {
+        getClassTag(jvmtiEnv, classes[i]);
+        jniEnv->DeleteLocalRef(classes[i]);
+    }
+    jvmtiEnv->Deallocate((unsigned char *)classes);
+
+    size_t tableSize = (size_t)getClassTagCount() + 1;
+    histogram.instances.assign(tableSize, 0);
+    histogram.bytes.assign(tableSize, 0);
+    histogram.totalInstances = 0;
+    histogram.totalBytes = 0;
+    histogram.untaggedInstances = 0;
+
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.heap_iteration_callback = &heapHistogramCallback;
+    err = jvmtiEnv->IterateThroughHeap(0, NULL, &callbacks, &histogram);
+    return check_jvmti_error(jvmtiEnv, err, "Unable to iterate through the heap.\n");
+}
+
+static void retainHeapSnapshot(const heap_histogram_t& histogram)
+{
+    heap_snapshot_t snapshot;
+    snapshot.time = chrono::steady_clock::now();
+    snapshot.totalInstances = histogram.totalInstances;
+    snapshot.totalBytes = histogram.totalBytes;
+    for (size_t tag = 1; tag < histogram.instances.size(); tag++)
+    {
+        if (histogram.instances[tag] > 0)
+        {
+            snapshot.entries.push_back({(uint32_t)tag, histogram.instances[tag], histogram.bytes[tag]});
+        }
+    }
+
+    heapSnapshots.push_back(move(snapshot));
+    while (heapSnapshots.size() > heapSnapshotsRetained)
+    {
+        heapSnapshots.pop_front();
+    }
+}
+
+static const heap_snapshot_entry_t *findSnapshotEntry(const heap_snapshot_t& snapshot, uint32_t tag)
+{
+    auto it = lower_bound(snapshot.entries.begin(), snapshot.entries.end(), tag,
+        [](const heap_snapshot_entry_t& entry, uint32_t t) { return entry.tag < t; });
+    if (it == snapshot.entries.end() || it->tag != tag)
+    {
+        return NULL;
+    }
+    return &*it;
+}
+
+/* Number of consecutive retained snapshots, ending with the newest, in which the class grew */
+static int growingSnapshots(uint32_t tag)
+{
+    int growing = 0;
+    jlong newer = 0;
+    const heap_snapshot_entry_t *entry = findSnapshotEntry(heapSnapshots.back(), tag);
+
+    newer = (entry != NULL) ? entry->bytes : 0;
+    for (size_t i = heapSnapshots.size() - 1; i > 0; i--)
+    {
+        entry = findSnapshotEntry(heapSnapshots[i - 1], tag);
+        jlong older = (entry != NULL) ? entry->bytes : 0;
+        if (newer <= older)
+        {
+            break;
+        }
+        growing++;
+        newer = older;
+    }
+    return growing;
+}
+
+struct heap_growth_t
+{
+    const heap_snapshot_entry_t *current;
+    jlong instancesDelta;
+    jlong bytesDelta;
+};
+
+static json growthToJson(const vector<heap_growth_t>& growth, size_t count, double seconds)
+{
+    json jGrowth = json::array();
+    for (size_t i = 0; i < count; i++)
+    {
+        json jClass;
+        jClass["className"] = getClassTagName(growth[i].current->tag);
+        jClass["instances"] = growth[i].current->instances;
+        jClass["bytes"] = growth[i].current->bytes;
+        jClass["instancesDelta"] = growth[i].instancesDelta;
+        jClass["bytesDelta"] = growth[i].bytesDelta;
+        jClass["instancesPerSecond"] = seconds > 0 ? growth[i].instancesDelta / seconds : 0.0;
+        jClass["bytesPerSecond"] = seconds > 0 ? growth[i].bytesDelta / seconds : 0.0;
+        jClass["growingSnapshots"] = growingSnapshots(growth[i].current->tag);
+        jGrowth.push_back(jClass);
+    }
+    return jGrowth;
+}
+
+static void sendHeapDiff(int topN)
+{
+    const heap_snapshot_t& current = heapSnapshots.back();
+    json jDiff;
+
+    jDiff["snapshots"] = heapSnapshots.size();
+    jDiff["totalInstances"] = current.totalInstances;
+    jDiff["totalBytes"] = current.totalBytes;
+    if (heapSnapshots.size() < 2)
+    {
+        /* nothing to compare with yet, this snapshot is the baseline */
+        jDiff["bytesGrowth"] = json::array();
+        jDiff["instancesGrowth"] = json::array();
+        json j;
+        j["heapDiff"] = jDiff;
+        sendToServer(j.dump());
+        return;
+    }
+
+    const heap_snapshot_t& previous = heapSnapshots[heapSnapshots.size() - 2];
+    double seconds = chrono::duration<double>(current.time - previous.time).count();
+
+    vector<heap_growth_t> growth;
+    for (const heap_snapshot_entry_t& entry : current.entries)
+    {
+        const heap_snapshot_entry_t *old = findSnapshotEntry(previous, entry.tag);
+        jlong instancesDelta = entry.instances - ((old != NULL) ? old->instances : 0);
+        jlong bytesDelta = entry.bytes - ((old != NULL) ? old->bytes : 0);
+        if (instancesDelta > 0 || bytesDelta > 0)
+        {
+            growth.push_back({&entry, instancesDelta, bytesDelta});
+        }
+    }
+    size_t reported = min(growth.size(), (size_t)max(topN, 0));
+
+    jDiff["elapsedSeconds"] = seconds;
+    jDiff["totalInstancesDelta"] = current.totalInstances - previous.totalInstances;
+    jDiff["totalBytesDelta"] = current.totalBytes - previous.totalBytes;
+    jDiff["growingClasses"] = growth.size();
+
+    partial_sort(growth.begin(), growth.begin() + reported, growth.end(),
+        [](const heap_growth_t& a, const heap_growth_t& b) { return a.bytesDelta > b.bytesDelta; });
+    jDiff["bytesGrowth"] = growthToJson(growth, reported, seconds);
+
+    partial_sort(growth.begin(), growth.begin() + reported, growth.end(),
+        [](const heap_growth_t& a, const heap_growth_t& b) { return a.instancesDelta > b.instancesDelta; });
+    jDiff["instancesGrowth"] = growthToJson(growth, reported, seconds);
+
+    json j;
+    j["heapDiff"] = jDiff;
+    sendToServer(j.dump());
+}
+
+void requestHeapHistogram(int topN)
+{
+    submitTask([topN](jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv) {
+        heap_histogram_t histogram;
+        auto start = chrono::steady_clock::now();
+
+        if (!collectHeapHistogram(jvmtiEnv, jniEnv, histogram))
+        {
+            return;
+        }
+        double durationMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        retainHeapSnapshot(histogram);
+
+        vector<jlong> tags;
+        for (jlong tag = 1; tag < (jlong)histogram.instances.size(); tag++)
+        {
+            if (histogram.instances[tag] > 0)
+            {
+                tags.push_back(tag);
+            }
+        }
+        size_t reported = min(tags.size(), (size_t)max(topN, 0));
+        partial_sort(tags.begin(), tags.begin() + reported, tags.end(), [&histogram](jlong a, jlong b) {
+            return histogram.bytes[a] > histogram.bytes[b];
+        });
+
+        json jHistogram;
+        jHistogram["durationMs"] = durationMs;
+        jHistogram["classes"] = tags.size();
+        jHistogram["totalInstances"] = histogram.totalInstances;
+        jHistogram["totalBytes"] = histogram.totalBytes;
+        jHistogram["untaggedInstances"] = histogram.untaggedInstances;
+        jHistogram["top"] = json::array();
+        for (size_t i = 0; i < reported; i++)
+        {
+            json jClass;
+            jClass["className"] = getClassTagName(tags[i]);
+            jClass["instances"] = histogram.instances[tags[i]];
+            jClass["bytes"] = histogram.bytes[tags[i]];
+            jHistogram["top"].push_back(jClass);
+        }
+
+        json j;
+        j["heapHistogram"] = jHistogram;
+        sendToServer(j.dump());
+    });
+}
+
+void requestHeapDiff(int topN, int retain)
+{
+    submitTask([topN, retain](jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv) {
+        heap_histogram_t histogram;
+
+        if (retain > 0)
+        {
+            heapSnapshotsRetained = (size_t)retain;
+        }
+        if (!collectHeapHistogram(jvmtiEnv, jniEnv, histogram))
+        {
+            return;
+        }
+        retainHeapSnapshot(histogram);
+        sendHeapDiff(topN);
+    });
+}
@@ -0,0 +1,252 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <jvmti.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "agentOptions.hpp"
+#include "classTags.hpp"
+#include "heapSnapshot.hpp"
+#include "heapSnapshotFormat.hpp"
+#include "heapWalk.hpp"
+#include "infra.hpp"
+#include "json.hpp"
+#include "scheduler.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+struct heap_snapshot_writer_t
+{
+    int fd;
+    bool failed;
+    uint64_t fileBytes;
+    uint64_t objectCount;       /* also the id of the last object written */
+    uint64_t referenceCount;
+    uint64_t previousFrom;
+    vector<uint64_t> classObjects;  /* object id of each class object, by class tag */
+    vector<uint8_t> objects;
+    vector<uint8_t> references;
+};
+
+static void writeFully(heap_snapshot_writer_t *writer, const uint8_t *data, size_t length)
+{
+    while (length > 0 && !writer->failed)
+    {
+        ssize_t written = write(writer->fd, data, length);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            writer->failed = true;
+            return;
+        }
+        data += written;
+        length -= (size_t)written;
+        writer->fileBytes += (uint64_t)written;
+    }
+}
+
+static void writeChunk(heap_snapshot_writer_t *writer, heap_snapshot_chunk_t type, vector<uint8_t>& payload)
+{
+    uint8_t header[1 + HEAP_SNAPSHOT_VARINT_MAX];
+
+    header[0] = (uint8_t)type;
+    size_t headerLength = 1 + writeVarint(header + 1, payload.size());
+    writeFully(writer, header, headerLength);
+    writeFully(writer, payload.data(), payload.size());
+    payload.clear();
+}
+
+static inline void appendVarint(vector<uint8_t>& buffer, uint64_t value)
+{
+    uint8_t encoded[HEAP_SNAPSHOT_VARINT_MAX];
+    buffer.insert(buffer.end(), encoded, encoded + writeVarint(encoded, value));
+}
+
+/* Object id of a tagged object, or 0 if it has not been written yet */
+static uint64_t snapshotObjectId(heap_snapshot_writer_t *writer, jlong tag)
+{
+    jlong classTag = heapWalkClassTag(tag);
+    if (classTag == 0)
+    {
+        return (uint64_t)tag;
+    }
+    return (classTag < (jlong)writer->classObjects.size()) ? writer->classObjects[classTag] : 0;
+}
+
+static jint JNICALL heapSnapshotReferenceCallback(jvmtiHeapReferenceKind referenceKind,
+    const jvmtiHeapReferenceInfo *referenceInfo, jlong classTag, jlong referrerClassTag, jlong size,
+    jlong *tagPtr, jlong *referrerTagPtr, jint length, void *userData)
+{
+    heap_snapshot_writer_t *writer = (heap_snapshot_writer_t *)userData;
+    uint64_t id = snapshotObjectId(writer, *tagPtr);
+
+    if (writer->failed)
+    {
+        return JVMTI_VISIT_ABORT;
+    }
+
+    if (id == 0)
+    {
+        id = ++writer->objectCount;
+        jlong ownClassTag = heapWalkClassTag(*tagPtr);
+        if (ownClassTag != 0 && ownClassTag < (jlong)writer->classObjects.size())
+        {
+            writer->classObjects[ownClassTag] = id;
+        }
+        else
+        {
+            *tagPtr = (jlong)id;
+        }
+        appendVarint(writer->objects, (uint64_t)heapWalkClassTag(classTag));
+        appendVarint(writer->objects, (uint64_t)size);
+        appendVarint(writer->objects, (length >= 0) ? (uint64_t)length + 1 : 0);
+        if (writer->objects.size() >= HEAP_SNAPSHOT_CHUNK_SIZE)
+        {
+            writeChunk(writer, HEAP_SNAPSHOT_CHUNK_OBJECTS, writer->objects);
+        }
+    }
+
+    /* references of one object are reported together, so from deltas are mostly 0 */
+    uint64_t from = (referrerTagPtr == NULL) ? 0 : snapshotObjectId(writer, *referrerTagPtr);
+    writer->references.push_back((uint8_t)referenceKind);
+    appendVarint(writer->references, zigzagEncode((int64_t)(from - writer->previousFrom)));
+    appendVarint(writer->references, zigzagEncode((int64_t)(id - from)));
+    writer->previousFrom = from;
+    writer->referenceCount++;
+    if (writer->references.size() >= HEAP_SNAPSHOT_CHUNK_SIZE)
+    {
+        writeChunk(writer, HEAP_SNAPSHOT_CHUNK_REFERENCES, writer->references);
+        writer->previousFrom = 0;
+    }
+
+    return JVMTI_VISIT_OBJECTS;
+}
+
+static void writeClassChunks(heap_snapshot_writer_t *writer)
+{
+    vector<uint8_t> strings, classes;
+
+    /* class names are the only strings, so a class' name id is its class tag */
+    for (jlong tag = 1; tag < (jlong)writer->classObjects.size(); tag++)
+    {
+        string name = getClassTagName(tag);
+        appendVarint(strings, (uint64_t)tag);
+        appendVarint(strings, name.size());
+        strings.insert(strings.end(), name.begin(), name.end());
+        if (strings.size() >= HEAP_SNAPSHOT_CHUNK_SIZE)
+        {
+            writeChunk(writer, HEAP_SNAPSHOT_CHUNK_STRINGS, strings);
+        }
+
+        appendVarint(classes, (uint64_t)tag);
+        appendVarint(classes, (uint64_t)tag);
+        appendVarint(classes, writer->classObjects[tag]);
+        if (classes.size() >= HEAP_SNAPSHOT_CHUNK_SIZE)
+        {
+            writeChunk(writer, HEAP_SNAPSHOT_CHUNK_CLASSES, classes);
+        }
+    }
+    writeChunk(writer, HEAP_SNAPSHOT_CHUNK_STRINGS, strings);
+    writeChunk(writer, HEAP_SNAPSHOT_CHUNK_CLASSES, classes);
+}
+
+void requestHeapSnapshot(const string& fileName)
+{
+    if (fileName.empty() || fileName.find('/') != string::npos || fileName == "." || fileName == "..")
+    {
+        printf("ERROR: heap snapshot file must be a file name in the working directory: %s\n", fileName.c_str());
+        return;
+    }
+
+    submitTask([fileName](jvmtiEnv *jvmti_env, JNIEnv *jni_env) {
+        heap_snapshot_writer_t writer;
+        jvmtiHeapCallbacks callbacks;
+        jvmtiError err;
+        uint8_t header[HEAP_SNAPSHOT_MAGIC_LENGTH + HEAP_SNAPSHOT_VARINT_MAX];
+
+        /* never overwrite an existing file */
+        writer.fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (writer.fd < 0)
+        {
+            perror("ERROR: Unable to open heap snapshot file");
+            return;
+        }
+        writer.failed = false;
+        writer.fileBytes = 0;
+        writer.objectCount = 0;
+        writer.referenceCount = 0;
+        writer.previousFrom = 0;
+        writer.objects.reserve(HEAP_SNAPSHOT_CHUNK_SIZE + 3 * HEAP_SNAPSHOT_VARINT_MAX);
+        writer.references.reserve(HEAP_SNAPSHOT_CHUNK_SIZE + 1 + 2 * HEAP_SNAPSHOT_VARINT_MAX);
+
+        memcpy(header, HEAP_SNAPSHOT_MAGIC, HEAP_SNAPSHOT_MAGIC_LENGTH);
+        size_t headerLength = HEAP_SNAPSHOT_MAGIC_LENGTH + writeVarint(header + HEAP_SNAPSHOT_MAGIC_LENGTH, HEAP_SNAPSHOT_VERSION);
+        writeFully(&writer, header, headerLength);
+
+        auto start = chrono::steady_clock::now();
+        jvmtiEnv *walkEnv = createHeapWalkEnv();
+        bool walked = false;
+        if (walkEnv != NULL)
+        {
+            if (tagClassesForHeapWalk(walkEnv, jvmti_env, jni_env))
+            {
+                writer.classObjects.assign((size_t)getClassTagCount() + 1, 0);
+                memset(&callbacks, 0, sizeof(callbacks));
+                callbacks.heap_reference_callback = &heapSnapshotReferenceCallback;
+                err = walkEnv->FollowReferences(0, NULL, NULL, &callbacks, &writer);
+                walked = check_jvmti_error(walkEnv, err, "Unable to follow references.\n");
+            }
+            disposeHeapWalkEnv(walkEnv);
+        }
+
+        writeChunk(&writer, HEAP_SNAPSHOT_CHUNK_OBJECTS, writer.objects);
+        writeChunk(&writer, HEAP_SNAPSHOT_CHUNK_REFERENCES, writer.references);
+        writeClassChunks(&writer);
+        vector<uint8_t> end;
+        writeChunk(&writer, HEAP_SNAPSHOT_CHUNK_END, end);
+        close(writer.fd);
+
+        json jSnapshot;
+        jSnapshot["file"] = fileName;
+        jSnapshot["complete"] = walked && !writer.failed;
+        jSnapshot["durationMs"] = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        jSnapshot["objects"] = writer.objectCount;
+        jSnapshot["references"] = writer.referenceCount;
+        jSnapshot["classes"] = writer.classObjects.size() > 0 ? writer.classObjects.size() - 1 : 0;
+        jSnapshot["fileBytes"] = writer.fileBytes;
+
+        json j;
+        j["heapSnapshot"] = jSnapshot;
+        sendToServer(j.dump());
+    });
+}
@@ -0,0 +1,196 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "heapSnapshot.hpp"
+#include "heapSnapshotFormat.hpp"
+
+using namespace std;
+
+static const char *referenceKindName(uint8_t kind)
+{
+    /* jvmtiHeapReferenceKind values, fixed by the JVMTI specification */
+    static const char *names[] = {
+        "unknown", "class", "field", "arrayElement", "classLoader", "signers", "protectionDomain",
+        "interface", "staticField", "constantPool", "superclass"
+    };
+    static const char *rootNames[] = {
+        "jniGlobal", "systemClass", "monitor", "stackLocal", "jniLocal", "thread", "other"
+    };
+
+    if (kind < sizeof(names) / sizeof(names[0]))
+    {
+        return names[kind];
+    }
+    if (kind >= 21 && kind < 21 + sizeof(rootNames) / sizeof(rootNames[0]))
+    {
+        return rootNames[kind - 21];
+    }
+    return "unknown";
+}
+
+static bool readFileVarint(FILE *file, uint64_t *value)
+{
+    uint8_t bytes[HEAP_SNAPSHOT_VARINT_MAX];
+    size_t used = 0;
+    int c;
+
+    do
+    {
+        if (used == HEAP_SNAPSHOT_VARINT_MAX || (c = fgetc(file)) == EOF)
+        {
+            return false;
+        }
+        bytes[used++] = (uint8_t)c;
+    } while (c & 0x80);
+    return readVarint(bytes, bytes + used, value) > 0;
+}
+
+static bool readChunk(FILE *file, uint8_t *type, vector<uint8_t>& payload)
+{
+    uint64_t length = 0;
+    int c;
+
+    if ((c = fgetc(file)) == EOF || !readFileVarint(file, &length))
+    {
+        return false;
+    }
+    *type = (uint8_t)c;
+
+    /* the length comes from the file, a corrupt one must not size the buffer */
+    if (length > HEAP_SNAPSHOT_CHUNK_MAX)
+    {
+        fprintf(stderr, "ERROR: chunk of %llu bytes is larger than any heap snapshot chunk\n", (unsigned long long)length);
+        return false;
+    }
+    payload.resize(length);
+    return length == 0 || fread(payload.data(), 1, length, file) == length;
+}
+
+bool decodeHeapSnapshot(const char *fileName, FILE *out)
+{
+    char magic[HEAP_SNAPSHOT_MAGIC_LENGTH];
+    uint64_t version = 0;
+    uint64_t objectId = 0;
+    vector<uint8_t> payload;
+    uint8_t type;
+
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL)
+    {
+        perror("ERROR opening heap snapshot");
+        return false;
+    }
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic)
+        || memcmp(magic, HEAP_SNAPSHOT_MAGIC, HEAP_SNAPSHOT_MAGIC_LENGTH) != 0
+        || !readFileVarint(file, &version) || version != HEAP_SNAPSHOT_VERSION)
+    {
+        fprintf(stderr, "ERROR: %s is not a version %d heap snapshot\n", fileName, HEAP_SNAPSHOT_VERSION);
+        fclose(file);
+        return false;
+    }
+
+    bool complete = false;
+    while (!complete && readChunk(file, &type, payload))
+    {
+        const uint8_t *p = payload.data();
+        const uint8_t *end = p + payload.size();
+        uint64_t a, b, c;
+        size_t n;
+        uint64_t previousFrom = 0;
+
+        switch (type)
+        {
+            case HEAP_SNAPSHOT_CHUNK_END:
+                complete = true;
+                break;
+            case HEAP_SNAPSHOT_CHUNK_STRINGS:
+                while (p < end && (n = readVarint(p, end, &a)) > 0 && (p += n, (n = readVarint(p, end, &b)) > 0)
+                    && (uint64_t)(end - p - n) >= b)
+                {
+                    p += n;
+                    /* strings are class signatures, which never contain quotes or backslashes */
+                    fprintf(out, "{\"string\":%llu,\"value\":\"%.*s\"}\n", (unsigned long long)a, (int)b, (const char *)p);
+                    p += b;
+                }
+                break;
+            case HEAP_SNAPSHOT_CHUNK_CLASSES:
+                while (p < end && (n = readVarint(p, end, &a)) > 0 && (p += n, (n = readVarint(p, end, &b)) > 0)
+                    && (p += n, (n = readVarint(p, end, &c)) > 0))
+                {
+                    p += n;
+                    fprintf(out, "{\"class\":%llu,\"name\":%llu,\"object\":%llu}\n",
+                        (unsigned long long)a, (unsigned long long)b, (unsigned long long)c);
+                }
+                break;
+            case HEAP_SNAPSHOT_CHUNK_OBJECTS:
+                while (p < end && (n = readVarint(p, end, &a)) > 0 && (p += n, (n = readVarint(p, end, &b)) > 0)
+                    && (p += n, (n = readVarint(p, end, &c)) > 0))
+                {
+                    p += n;
+                    objectId++;
+                    if (c > 0)
+                    {
+                        fprintf(out, "{\"object\":%llu,\"class\":%llu,\"size\":%llu,\"length\":%llu}\n", (unsigned long long)objectId,
+                            (unsigned long long)a, (unsigned long long)b, (unsigned long long)(c - 1));
+                    }
+                    else
+                    {
+                        fprintf(out, "{\"object\":%llu,\"class\":%llu,\"size\":%llu}\n", (unsigned long long)objectId,
+                            (unsigned long long)a, (unsigned long long)b);
+                    }
+                }
+                break;
+            case HEAP_SNAPSHOT_CHUNK_REFERENCES:
+                while (p < end)
+                {
+                    uint8_t kind = *p++;
+                    if ((n = readVarint(p, end, &a)) == 0 || (p += n, (n = readVarint(p, end, &b)) == 0))
+                    {
+                        break;
+                    }
+                    p += n;
+                    uint64_t from = previousFrom + (uint64_t)zigzagDecode(a);
+                    uint64_t to = from + (uint64_t)zigzagDecode(b);
+                    previousFrom = from;
+                    fprintf(out, "{\"from\":%llu,\"to\":%llu,\"kind\":\"%s\"}\n",
+                        (unsigned long long)from, (unsigned long long)to, referenceKindName(kind));
+                }
+                break;
+            default:
+                /* chunks added by later versions are skipped */
+                break;
+        }
+    }
+    fclose(file);
+
+    if (!complete)
+    {
+        fprintf(stderr, "ERROR: %s is truncated or corrupt\n", fileName);
+    }
+    return complete;
+}
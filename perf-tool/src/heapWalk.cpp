@@ -0,0 +1,114 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <jvmti.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "agentOptions.hpp"
+#include "classTags.hpp"
+#include "heapWalk.hpp"
+#include "infra.hpp"
+
+jvmtiEnv *createHeapWalkEnv(void)
+{
+    jvmtiEnv *walkEnv = NULL;
+    jvmtiCapabilities capa;
+    jvmtiError err;
+
+    if (javaVM->GetEnv((void **)&walkEnv, JVMTI_VERSION_1_2) != JNI_OK || walkEnv == NULL)
+    {
+        printf("ERROR: Unable to create a JVMTI environment for the heap walk.\n");
+        return NULL;
+    }
+
+    memset(&capa, 0, sizeof(jvmtiCapabilities));
+    capa.can_tag_objects = 1;
+    err = walkEnv->AddCapabilities(&capa);
+    if (!check_jvmti_error(walkEnv, err, "Unable to add tag objects capability for the heap walk.\n"))
+    {
+        walkEnv->DisposeEnvironment();
+        return NULL;
+    }
+    return walkEnv;
+}
+
+void disposeHeapWalkEnv(jvmtiEnv *walkEnv)
+{
+    jvmtiError err = walkEnv->DisposeEnvironment();
+    check_jvmti_error(jvmti, err, "Unable to dispose of the heap walk environment.\n");
+}
+
+bool tagClassesForHeapWalk(jvmtiEnv *walkEnv, jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv)
+{
+    jvmtiError err;
+    jint classCount = 0;
+    jclass *classes = NULL;
+
+    err = jvmtiEnv->GetLoadedClasses(&classCount, &classes);
+    if (!check_jvmti_error(jvmtiEnv, err, "Unable to get loaded classes.\n"))
+    {
+        return false;
+    }
+    for (jint i = 0; i < classCount; i++)
+    {
+        jlong classTag = getClassTag(jvmtiEnv, classes[i]);
+        if (classTag != 0)
+        {
+            walkEnv->SetTag(classes[i], HEAP_WALK_CLASS_BIT | classTag);
+        }
+        jniEnv->DeleteLocalRef(classes[i]);
+    }
+    jvmtiEnv->Deallocate((unsigned char *)classes);
+    return true;
+}
+
+const char *heapReferenceKindName(jvmtiHeapReferenceKind kind)
+{
+    switch (kind)
+    {
+        case JVMTI_HEAP_REFERENCE_JNI_GLOBAL:
+            return "jniGlobal";
+        case JVMTI_HEAP_REFERENCE_SYSTEM_CLASS:
+            return "systemClass";
+        case JVMTI_HEAP_REFERENCE_MONITOR:
+            return "monitor";
+        case JVMTI_HEAP_REFERENCE_STACK_LOCAL:
+            return "stackLocal";
+        case JVMTI_HEAP_REFERENCE_JNI_LOCAL:
+            return "jniLocal";
+        case JVMTI_HEAP_REFERENCE_THREAD:
+            return "thread";
+        case JVMTI_HEAP_REFERENCE_OTHER:
+            return "other";
+        case JVMTI_HEAP_REFERENCE_CLASS:
+            return "class";
+        case JVMTI_HEAP_REFERENCE_FIELD:
+            return "field";
+        case JVMTI_HEAP_REFERENCE_ARRAY_ELEMENT:
+            return "arrayElement";
+        case JVMTI_HEAP_REFERENCE_STATIC_FIELD:
+            return "staticField";
+        default:
+            return "unknown";
+    }
+}
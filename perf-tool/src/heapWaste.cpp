@@ -0,0 +1,514 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <jvmti.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "agentOptions.hpp"
+#include "classTags.hpp"
+#include "heapWalk.hpp"
+#include "heapWaste.hpp"
+#include "infra.hpp"
+#include "json.hpp"
+#include "objectalloc.hpp"
+#include "objectLifetime.hpp"
+#include "scheduler.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+/*
+ * Walk environment tags, next to the HEAP_WALK_CLASS_BIT class tags. In lifetime mode the
+ * sampled objects first get HEAP_WASTE_SITE_BIT | their allocation site in bits 32-47.
+ * FollowReferences then tags object arrays with their index in objectArrays plus one, the
+ * value array of a String with HEAP_WASTE_VALUE_TAG, and adds HEAP_WASTE_STRING_BIT | the
+ * value array's size to the String.
+ */
+#define HEAP_WASTE_STRING_BIT ((jlong)1 << 61)
+#define HEAP_WASTE_VALUE_TAG ((jlong)1 << 60)
+#define HEAP_WASTE_SITE_BIT ((jlong)1 << 59)
+#define HEAP_WASTE_SITE_SHIFT (32)
+#define HEAP_WASTE_SITE_MASK (HEAP_WASTE_SITE_BIT | ((((jlong)1 << LIFETIME_SITE_BITS) - 1) << HEAP_WASTE_SITE_SHIFT))
+#define HEAP_WASTE_VALUE_SIZE_MASK (((jlong)1 << 32) - 1)
+#define HEAP_WASTE_TAG_BATCH (1024)     /* lifetime tags looked up per GetObjectsWithTags call */
+
+/* Contents are identified by a 64 bit hash only, a collision merely merges two rows */
+struct heap_content_t
+{
+    uint32_t classTag;
+    uint32_t count;
+    uint64_t bytes;         /* of the first copy */
+    uint64_t wastedBytes;   /* of every other copy */
+    string preview;         /* strings only, filled in on the first duplicate */
+};
+
+/* An object array and how many of its elements are set, found by FollowReferences */
+struct heap_object_array_t
+{
+    uint32_t ownerClassTag; /* class of the object whose field refers to the array */
+    int32_t length;
+    uint32_t elements;
+    uint64_t bytes;
+};
+
+/* A string or primitive array allocated at a sampled lifetime site */
+struct heap_site_object_t
+{
+    uint64_t hash;
+    uint64_t bytes;
+    uint32_t site;
+    bool isString;
+};
+
+struct heap_waste_t
+{
+    unordered_map<uint64_t, heap_content_t> strings;
+    unordered_map<uint64_t, heap_content_t> arrays;
+    vector<bool> isObjectArrayClass;    /* by class tag */
+    vector<bool> isPrimitiveArrayClass;
+    jlong stringClassTag;
+    vector<heap_object_array_t> objectArrays;
+    vector<heap_site_object_t> siteObjects;
+};
+
+struct heap_waste_site_t
+{
+    uint64_t duplicates;
+    double wastedBytes;
+};
+
+struct heap_waste_class_t
+{
+    uint64_t objects;
+    uint64_t duplicates;
+    uint64_t wastedBytes;
+};
+
+static inline uint64_t mixHash(uint64_t hash, uint64_t value)
+{
+    /* FNV-1a style mixing on whole words */
+    hash ^= value;
+    hash *= 0x100000001b3ULL;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+static uint64_t hashContent(const void *data, size_t length, uint64_t seed)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint64_t hash = mixHash(0xcbf29ce484222325ULL, seed);
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = mixHash(hash, word);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + i, length - i);
+    hash = mixHash(hash, tail);
+    return mixHash(hash, (uint64_t)length);
+}
+
+static inline uint32_t heapWasteTagSite(jlong tag)
+{
+    return (uint32_t)((tag & HEAP_WASTE_SITE_MASK & ~HEAP_WASTE_SITE_BIT) >> HEAP_WASTE_SITE_SHIFT);
+}
+
+static size_t primitiveSize(jvmtiPrimitiveType type)
+{
+    switch (type)
+    {
+        case JVMTI_PRIMITIVE_TYPE_BOOLEAN:
+        case JVMTI_PRIMITIVE_TYPE_BYTE:
+            return 1;
+        case JVMTI_PRIMITIVE_TYPE_CHAR:
+        case JVMTI_PRIMITIVE_TYPE_SHORT:
+            return 2;
+        case JVMTI_PRIMITIVE_TYPE_INT:
+        case JVMTI_PRIMITIVE_TYPE_FLOAT:
+            return 4;
+        default:
+            return 8;
+    }
+}
+
+static jint JNICALL heapWasteStringCallback(jlong classTag, jlong size, jlong *tagPtr,
+    const jchar *value, jint valueLength, void *userData)
+{
+    heap_waste_t *waste = (heap_waste_t *)userData;
+    uint64_t hash = hashContent(value, (size_t)valueLength * sizeof(jchar), 0);
+    heap_content_t& content = waste->strings[hash];
+    /* size only covers the String object, its value array is what deduplication saves */
+    uint64_t bytes = (uint64_t)size + ((*tagPtr & HEAP_WASTE_STRING_BIT) ? (uint64_t)(*tagPtr & HEAP_WASTE_VALUE_SIZE_MASK) : 0);
+
+    if (content.count == 0)
+    {
+        content.classTag = (uint32_t)heapWalkClassTag(classTag);
+        content.bytes = bytes;
+    }
+    else
+    {
+        content.wastedBytes += bytes;
+    }
+    if (*tagPtr & HEAP_WASTE_SITE_BIT)
+    {
+        waste->siteObjects.push_back({hash, bytes, heapWasteTagSite(*tagPtr), true});
+    }
+    if (content.count == 1)
+    {
+        jint previewLength = min(valueLength, (jint)HEAP_WASTE_PREVIEW_LENGTH);
+        for (jint i = 0; i < previewLength; i++)
+        {
+            content.preview.push_back((value[i] >= 0x20 && value[i] < 0x7f) ? (char)value[i] : '?');
+        }
+    }
+    content.count++;
+
+    return 0;
+}
+
+static jint JNICALL heapWasteArrayCallback(jlong classTag, jlong size, jlong *tagPtr,
+    jint elementCount, jvmtiPrimitiveType elementType, const void *elements, void *userData)
+{
+    heap_waste_t *waste = (heap_waste_t *)userData;
+
+    if (*tagPtr == HEAP_WASTE_VALUE_TAG)
+    {
+        /* counted with its String */
+        return 0;
+    }
+
+    uint64_t hash = hashContent(elements, (size_t)elementCount * primitiveSize(elementType), (uint64_t)elementType);
+    heap_content_t& content = waste->arrays[hash];
+
+    if (content.count == 0)
+    {
+        content.classTag = (uint32_t)heapWalkClassTag(classTag);
+        content.bytes = (uint64_t)size;
+    }
+    else
+    {
+        content.wastedBytes += (uint64_t)size;
+    }
+    content.count++;
+    if (*tagPtr & HEAP_WASTE_SITE_BIT)
+    {
+        waste->siteObjects.push_back({hash, (uint64_t)size, heapWasteTagSite(*tagPtr), false});
+    }
+
+    return 0;
+}
+
+static jint JNICALL heapWasteReferenceCallback(jvmtiHeapReferenceKind referenceKind,
+    const jvmtiHeapReferenceInfo *referenceInfo, jlong classTag, jlong referrerClassTag, jlong size,
+    jlong *tagPtr, jlong *referrerTagPtr, jint length, void *userData)
+{
+    heap_waste_t *waste = (heap_waste_t *)userData;
+    jlong arrayClassTag = heapWalkClassTag(classTag);
+
+    /* only object arrays are tagged, with their index in objectArrays plus one */
+    if ((*tagPtr & ~HEAP_WASTE_SITE_MASK) == 0 && length >= 0 && arrayClassTag < (jlong)waste->isObjectArrayClass.size()
+        && waste->isObjectArrayClass[arrayClassTag])
+    {
+        heap_object_array_t array;
+        array.ownerClassTag = (referenceKind == JVMTI_HEAP_REFERENCE_FIELD) ? (uint32_t)heapWalkClassTag(referrerClassTag) : 0;
+        array.length = length;
+        array.elements = 0;
+        array.bytes = (uint64_t)size;
+        waste->objectArrays.push_back(array);
+        *tagPtr = (jlong)waste->objectArrays.size();
+    }
+
+    /* a shared value array is only charged to the first String that refers to it */
+    if (referenceKind == JVMTI_HEAP_REFERENCE_FIELD && (*tagPtr & ~HEAP_WASTE_SITE_MASK) == 0 && referrerTagPtr != NULL
+        && heapWalkClassTag(referrerClassTag) == waste->stringClassTag && waste->stringClassTag != 0
+        && arrayClassTag < (jlong)waste->isPrimitiveArrayClass.size() && waste->isPrimitiveArrayClass[arrayClassTag])
+    {
+        *tagPtr = HEAP_WASTE_VALUE_TAG;
+        *referrerTagPtr = (*referrerTagPtr & HEAP_WASTE_SITE_MASK) | HEAP_WASTE_STRING_BIT | min((jlong)size, HEAP_WASTE_VALUE_SIZE_MASK);
+    }
+
+    if (referenceKind == JVMTI_HEAP_REFERENCE_ARRAY_ELEMENT && referrerTagPtr != NULL
+        && *referrerTagPtr > 0 && *referrerTagPtr <= (jlong)waste->objectArrays.size())
+    {
+        waste->objectArrays[*referrerTagPtr - 1].elements++;
+    }
+
+    return JVMTI_VISIT_OBJECTS;
+}
+
+static jint JNICALL lifetimeTagCallback(jlong classTag, jlong size, jlong *tagPtr, jint length, void *userData)
+{
+    if (lifetimeTagSite(*tagPtr) >= 0)
+    {
+        ((vector<jlong> *)userData)->push_back(*tagPtr);
+    }
+    return 0;
+}
+
+/* The lifetime tags of the main environment are not visible to the walk's callbacks,
+ * so the site of every sampled object is copied into the walk environment */
+static bool tagLifetimeSites(jvmtiEnv *walkEnv, jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv)
+{
+    jvmtiHeapCallbacks callbacks;
+    vector<jlong> tags;
+    jvmtiError err;
+
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.heap_iteration_callback = &lifetimeTagCallback;
+    err = jvmtiEnv->IterateThroughHeap(JVMTI_HEAP_FILTER_UNTAGGED, NULL, &callbacks, &tags);
+    if (!check_jvmti_error(jvmtiEnv, err, "Unable to iterate through the tagged objects.\n"))
+    {
+        return false;
+    }
+    sort(tags.begin(), tags.end());
+    tags.erase(unique(tags.begin(), tags.end()), tags.end());
+
+    for (size_t i = 0; i < tags.size(); i += HEAP_WASTE_TAG_BATCH)
+    {
+        jint tagCount = (jint)min(tags.size() - i, (size_t)HEAP_WASTE_TAG_BATCH);
+        jint objectCount = 0;
+        jobject *objects = NULL;
+        jlong *objectTags = NULL;
+
+        err = jvmtiEnv->GetObjectsWithTags(tagCount, &tags[i], &objectCount, &objects, &objectTags);
+        if (!check_jvmti_error(jvmtiEnv, err, "Unable to get the objects with lifetime tags.\n"))
+        {
+            return false;
+        }
+        for (jint j = 0; j < objectCount; j++)
+        {
+            walkEnv->SetTag(objects[j], HEAP_WASTE_SITE_BIT | ((jlong)lifetimeTagSite(objectTags[j]) << HEAP_WASTE_SITE_SHIFT));
+            jniEnv->DeleteLocalRef(objects[j]);
+        }
+        jvmtiEnv->Deallocate((unsigned char *)objects);
+        jvmtiEnv->Deallocate((unsigned char *)objectTags);
+    }
+    return true;
+}
+
+static bool walkHeapWaste(jvmtiEnv *walkEnv, heap_waste_t& waste)
+{
+    jvmtiHeapCallbacks callbacks;
+    jvmtiError err;
+
+    jlong classCount = getClassTagCount();
+    waste.isObjectArrayClass.assign((size_t)classCount + 1, false);
+    waste.isPrimitiveArrayClass.assign((size_t)classCount + 1, false);
+    waste.stringClassTag = 0;
+    for (jlong tag = 1; tag <= classCount; tag++)
+    {
+        string signature = getClassTagName(tag);
+        bool isArray = signature.size() > 1 && signature[0] == '[';
+        waste.isObjectArrayClass[tag] = isArray && (signature[1] == 'L' || signature[1] == '[');
+        waste.isPrimitiveArrayClass[tag] = isArray && !waste.isObjectArrayClass[tag];
+        if (signature == "Ljava/lang/String;")
+        {
+            waste.stringClassTag = tag;
+        }
+    }
+
+    /* references first, so the contents walk knows which arrays belong to a String */
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.heap_reference_callback = &heapWasteReferenceCallback;
+    err = walkEnv->FollowReferences(0, NULL, NULL, &callbacks, &waste);
+    if (!check_jvmti_error(walkEnv, err, "Unable to follow references.\n"))
+    {
+        return false;
+    }
+
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.string_primitive_value_callback = &heapWasteStringCallback;
+    callbacks.array_primitive_value_callback = &heapWasteArrayCallback;
+    err = walkEnv->IterateThroughHeap(0, NULL, &callbacks, &waste);
+    return check_jvmti_error(walkEnv, err, "Unable to iterate through the heap.\n");
+}
+
+static json topClassesToJson(const unordered_map<uint32_t, heap_waste_class_t>& classes, int topN, const char *countName)
+{
+    vector<pair<uint32_t, heap_waste_class_t>> sorted(classes.begin(), classes.end());
+    size_t reported = min(sorted.size(), (size_t)max(topN, 0));
+    partial_sort(sorted.begin(), sorted.begin() + reported, sorted.end(),
+        [](const pair<uint32_t, heap_waste_class_t>& a, const pair<uint32_t, heap_waste_class_t>& b) {
+            return a.second.wastedBytes > b.second.wastedBytes;
+        });
+
+    json jClasses = json::array();
+    for (size_t i = 0; i < reported; i++)
+    {
+        json jClass;
+        jClass["className"] = getClassTagName(sorted[i].first);
+        jClass["objects"] = sorted[i].second.objects;
+        jClass[countName] = sorted[i].second.duplicates;
+        jClass["wastedBytes"] = sorted[i].second.wastedBytes;
+        jClasses.push_back(jClass);
+    }
+    return jClasses;
+}
+
+/* Each sampled copy of a duplicated content is charged its share of the copies that could go */
+static json topSitesToJson(jvmtiEnv *jvmtiEnv, const heap_waste_t& waste, int topN)
+{
+    unordered_map<uint32_t, heap_waste_site_t> sites;
+    for (const heap_site_object_t& object : waste.siteObjects)
+    {
+        const unordered_map<uint64_t, heap_content_t>& contents = object.isString ? waste.strings : waste.arrays;
+        auto content = contents.find(object.hash);
+        if (content == contents.end() || content->second.count < 2)
+        {
+            continue;
+        }
+        heap_waste_site_t& site = sites[object.site];
+        site.duplicates++;
+        site.wastedBytes += (double)object.bytes * (content->second.count - 1) / content->second.count;
+    }
+
+    vector<pair<uint32_t, heap_waste_site_t>> sorted(sites.begin(), sites.end());
+    size_t reported = min(sorted.size(), (size_t)max(topN, 0));
+    partial_sort(sorted.begin(), sorted.begin() + reported, sorted.end(),
+        [](const pair<uint32_t, heap_waste_site_t>& a, const pair<uint32_t, heap_waste_site_t>& b) {
+            return a.second.wastedBytes > b.second.wastedBytes;
+        });
+
+    json jSites = json::array();
+    for (size_t i = 0; i < reported; i++)
+    {
+        json jSite = describeLifetimeSite(jvmtiEnv, (jint)sorted[i].first);
+        jSite["duplicates"] = sorted[i].second.duplicates;
+        jSite["wastedBytes"] = (uint64_t)sorted[i].second.wastedBytes;
+        jSites.push_back(jSite);
+    }
+    return jSites;
+}
+
+static void sendHeapWaste(jvmtiEnv *jvmtiEnv, heap_waste_t& waste, bool lifetimeSites, int topN, double walkMs)
+{
+    unordered_map<uint32_t, heap_waste_class_t> stringClasses, arrayClasses, collectionClasses;
+    vector<const heap_content_t *> duplicateStrings;
+    uint64_t totalWasted = 0;
+
+    for (auto& entry : waste.strings)
+    {
+        heap_waste_class_t& perClass = stringClasses[entry.second.classTag];
+        perClass.objects += entry.second.count;
+        if (entry.second.count > 1)
+        {
+            perClass.duplicates += entry.second.count - 1;
+            perClass.wastedBytes += entry.second.wastedBytes;
+            duplicateStrings.push_back(&entry.second);
+        }
+    }
+    for (auto& entry : waste.arrays)
+    {
+        heap_waste_class_t& perClass = arrayClasses[entry.second.classTag];
+        perClass.objects += entry.second.count;
+        perClass.duplicates += entry.second.count - 1;
+        perClass.wastedBytes += entry.second.wastedBytes;
+    }
+    for (const heap_object_array_t& array : waste.objectArrays)
+    {
+        /* arrays held by a field of some object, i.e. collection backing stores */
+        if (array.ownerClassTag == 0 || array.length == 0)
+        {
+            continue;
+        }
+        heap_waste_class_t& perClass = collectionClasses[array.ownerClassTag];
+        perClass.objects++;
+        if (array.elements * 100 <= (uint64_t)array.length * HEAP_WASTE_SPARSE_PERCENT)
+        {
+            perClass.duplicates++;
+            perClass.wastedBytes += array.bytes * (array.length - array.elements) / array.length;
+        }
+    }
+    for (auto *classes : {&stringClasses, &arrayClasses, &collectionClasses})
+    {
+        for (auto& entry : *classes)
+        {
+            totalWasted += entry.second.wastedBytes;
+        }
+    }
+
+    size_t reported = min(duplicateStrings.size(), (size_t)max(topN, 0));
+    partial_sort(duplicateStrings.begin(), duplicateStrings.begin() + reported, duplicateStrings.end(),
+        [](const heap_content_t *a, const heap_content_t *b) {
+            return a->wastedBytes > b->wastedBytes;
+        });
+    json jStrings = json::array();
+    for (size_t i = 0; i < reported; i++)
+    {
+        json jString;
+        jString["value"] = duplicateStrings[i]->preview;
+        jString["count"] = duplicateStrings[i]->count;
+        jString["wastedBytes"] = duplicateStrings[i]->wastedBytes;
+        jStrings.push_back(jString);
+    }
+
+    json jWaste;
+    if (lifetimeSites)
+    {
+        jWaste["allocationSites"] = topSitesToJson(jvmtiEnv, waste, topN);
+        jWaste["sampleRate"] = objAllocSampleRate.load();
+    }
+    jWaste["walkMs"] = walkMs;
+    jWaste["wastedBytes"] = totalWasted;
+    jWaste["duplicateStrings"] = jStrings;
+    jWaste["stringClasses"] = topClassesToJson(stringClasses, topN, "duplicates");
+    jWaste["arrayClasses"] = topClassesToJson(arrayClasses, topN, "duplicates");
+    jWaste["collectionClasses"] = topClassesToJson(collectionClasses, topN, "sparseArrays");
+
+    json j;
+    j["heapWaste"] = jWaste;
+    sendToServer(j.dump());
+}
+
+void requestHeapWaste(int topN)
+{
+    submitTask([topN](jvmtiEnv *jvmti_env, JNIEnv *jni_env) {
+        heap_waste_t waste;
+
+        jvmtiEnv *walkEnv = createHeapWalkEnv();
+        if (walkEnv == NULL)
+        {
+            return;
+        }
+
+        auto start = chrono::steady_clock::now();
+        bool lifetimeSites = objectLifetimeEnabled;
+        bool walked = tagClassesForHeapWalk(walkEnv, jvmti_env, jni_env)
+            && (!lifetimeSites || tagLifetimeSites(walkEnv, jvmti_env, jni_env))
+            && walkHeapWaste(walkEnv, waste);
+        disposeHeapWalkEnv(walkEnv);
+        if (walked)
+        {
+            double walkMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            sendHeapWaste(jvmti_env, waste, lifetimeSites, topN, walkMs);
+        }
+    });
+}
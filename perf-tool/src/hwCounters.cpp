@@ -0,0 +1,382 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#include <atomic>
+#include <chrono>
+#include <dirent.h>
+#include <errno.h>
+#include <fstream>
+#include <memory>
+#include <linux/perf_event.h>
+#include <mutex>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "hwCounters.hpp"
+#include "infra.hpp"
+#include "json.hpp"
+#include "perfSampler.hpp"
+#include "scheduler.hpp"
+#include "threads.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+struct hw_thread_counters_t
+{
+    pid_t tid;
+    string name;
+    int fds[HW_COUNTERS_MAX_EVENTS];    /* fds[0] leads the group */
+    uint64_t previous[HW_COUNTERS_MAX_EVENTS];
+    uint64_t previousEnabled;
+    uint64_t previousRunning;
+};
+
+/* what a read of a group leader returns with the read_format set in openCounterGroup */
+struct hw_group_read_t
+{
+    uint64_t count;
+    uint64_t timeEnabled;
+    uint64_t timeRunning;
+    uint64_t values[HW_COUNTERS_MAX_EVENTS];
+};
+
+/* the groups of one start of hwCounters; the periodic task keeps its own reference so that
+ * the final report after stop still has them */
+struct hw_counters_session_t
+{
+    vector<const perf_event_type_t *> events;
+    vector<hw_thread_counters_t> threads;
+    json exitedThreads = json::array();     /* final deltas of threads that ended since the last report */
+    chrono::steady_clock::time_point previousReport;
+    bool stopped = false;
+};
+
+static atomic<bool> hwCountersEnabled {false};
+static mutex hwCountersMutex;
+static shared_ptr<hw_counters_session_t> hwCounters;    /* NULL when stopped */
+
+static int openCounter(const perf_event_type_t *event, pid_t tid, int groupFd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event->type;
+    attr.config = event->config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    /* the leader starts disabled so the whole group is enabled at once */
+    attr.disabled = (groupFd == -1) ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return perfEventOpen(&attr, tid, groupFd);
+}
+
+/* Must be called with hwCountersMutex held */
+static bool openCounterGroup(hw_counters_session_t& session, pid_t tid, const string& name)
+{
+    hw_thread_counters_t counters;
+
+    /* a thread found in /proc/self/task by setHwCounters may post its ThreadStart afterwards */
+    for (hw_thread_counters_t& existing : session.threads)
+    {
+        if (existing.tid == tid)
+        {
+            if (!name.empty())
+            {
+                existing.name = name;
+            }
+            return true;
+        }
+    }
+
+    counters.tid = tid;
+    counters.name = name;
+    counters.previousEnabled = 0;
+    counters.previousRunning = 0;
+    for (size_t i = 0; i < session.events.size(); i++)
+    {
+        counters.previous[i] = 0;
+        counters.fds[i] = openCounter(session.events[i], tid, (i == 0) ? -1 : counters.fds[0]);
+        if (counters.fds[i] < 0)
+        {
+            while (i-- > 0)
+            {
+                close(counters.fds[i]);
+            }
+            return false;
+        }
+    }
+    ioctl(counters.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    session.threads.push_back(counters);
+    return true;
+}
+
+static void closeCounterGroup(hw_counters_session_t& session, hw_thread_counters_t& counters)
+{
+    for (size_t i = 0; i < session.events.size(); i++)
+    {
+        close(counters.fds[i]);
+    }
+}
+
+static int findEvent(const hw_counters_session_t& session, const char *name)
+{
+    for (size_t i = 0; i < session.events.size(); i++)
+    {
+        if (!strcmp(session.events[i]->name, name))
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/* Reads the counts of a group since its previous read into jThread. Returns false if the
+ * group did not run since. Must be called with hwCountersMutex held. */
+static bool readCounterGroup(const hw_counters_session_t& session, hw_thread_counters_t& counters, json& jThread)
+{
+    hw_group_read_t group;
+    ssize_t length = read(counters.fds[0], &group, sizeof(group));
+
+    if (length < (ssize_t)(3 * sizeof(uint64_t)) || group.count != session.events.size() || group.timeRunning <= counters.previousRunning)
+    {
+        return false;
+    }
+
+    int cycles = findEvent(session, "cycles"), instructions = findEvent(session, "instructions");
+    int cacheReferences = findEvent(session, "cache-references"), cacheMisses = findEvent(session, "cache-misses");
+    int branches = findEvent(session, "branches"), branchMisses = findEvent(session, "branch-misses");
+
+    /* counters are multiplexed when the group does not fit on the PMU, scale them up */
+    uint64_t enabled = group.timeEnabled - counters.previousEnabled;
+    uint64_t running = group.timeRunning - counters.previousRunning;
+    double scale = (double)enabled / running;
+    double deltas[HW_COUNTERS_MAX_EVENTS];
+
+    jThread["tid"] = counters.tid;
+    jThread["name"] = counters.name;
+    for (size_t i = 0; i < session.events.size(); i++)
+    {
+        deltas[i] = (group.values[i] - counters.previous[i]) * scale;
+        jThread[session.events[i]->name] = (uint64_t)deltas[i];
+        counters.previous[i] = group.values[i];
+    }
+    if (cycles >= 0 && instructions >= 0 && deltas[cycles] > 0)
+    {
+        jThread["ipc"] = deltas[instructions] / deltas[cycles];
+    }
+    if (cacheReferences >= 0 && cacheMisses >= 0 && deltas[cacheReferences] > 0)
+    {
+        jThread["cacheMissRatio"] = deltas[cacheMisses] / deltas[cacheReferences];
+    }
+    if (branches >= 0 && branchMisses >= 0 && deltas[branches] > 0)
+    {
+        jThread["branchMissRatio"] = deltas[branchMisses] / deltas[branches];
+    }
+    if (running < enabled)
+    {
+        jThread["runningRatio"] = (double)running / enabled;
+    }
+    counters.previousEnabled = group.timeEnabled;
+    counters.previousRunning = group.timeRunning;
+    return true;
+}
+
+/* Sends the deltas of every group. The report after stop is the last one, it closes the groups. */
+static void reportHwCounters(hw_counters_session_t& session)
+{
+    auto now = chrono::steady_clock::now();
+    pid_t pid = getpid();
+
+    lock_guard<mutex> lock(hwCountersMutex);
+    json jThreads = session.exitedThreads;
+    session.exitedThreads = json::array();
+
+    for (size_t t = 0; t < session.threads.size();)
+    {
+        hw_thread_counters_t& counters = session.threads[t];
+        /* threads that are not Java threads post no ThreadEnd; their group keeps its final
+         * counts after they exit, report them once more */
+        bool exited = tgkill(pid, counters.tid, 0) == -1 && errno == ESRCH;
+        json jThread;
+
+        if (readCounterGroup(session, counters, jThread))
+        {
+            if (exited)
+            {
+                jThread["exited"] = true;
+            }
+            jThreads.push_back(jThread);
+        }
+
+        if (exited || session.stopped)
+        {
+            closeCounterGroup(session, counters);
+            session.threads.erase(session.threads.begin() + t);
+        }
+        else
+        {
+            t++;
+        }
+    }
+
+    json j;
+    j["hwCounters"]["intervalSeconds"] = chrono::duration<double>(now - session.previousReport).count();
+    j["hwCounters"]["threads"] = jThreads;
+    session.previousReport = now;
+    sendToServer(j.dump());
+}
+
+void addThreadToHwCounters(void)
+{
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    java_thread_info_t info;
+
+    if (!hwCountersEnabled.load(memory_order_relaxed))
+    {
+        return;
+    }
+    lookupJavaThread(tid, info);
+
+    lock_guard<mutex> lock(hwCountersMutex);
+    if (hwCounters)
+    {
+        openCounterGroup(*hwCounters, tid, info.name);
+    }
+}
+
+void removeThreadFromHwCounters(void)
+{
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+
+    if (!hwCountersEnabled.load(memory_order_relaxed))
+    {
+        return;
+    }
+
+    lock_guard<mutex> lock(hwCountersMutex);
+    if (!hwCounters)
+    {
+        return;
+    }
+    /* the TID may be reused as soon as the thread is gone, so its group is read and closed now
+     * and its last deltas wait for the next report */
+    vector<hw_thread_counters_t>& threads = hwCounters->threads;
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        if (threads[t].tid == tid)
+        {
+            json jThread;
+            if (readCounterGroup(*hwCounters, threads[t], jThread))
+            {
+                jThread["exited"] = true;
+                hwCounters->exitedThreads.push_back(jThread);
+            }
+            closeCounterGroup(*hwCounters, threads[t]);
+            threads.erase(threads.begin() + t);
+            break;
+        }
+    }
+}
+
+bool setHwCounters(bool enabled, const vector<string>& events, int intervalSeconds)
+{
+    if (!enabled)
+    {
+        if (hwCountersEnabled.exchange(false))
+        {
+            {
+                lock_guard<mutex> lock(hwCountersMutex);
+                hwCounters->stopped = true;
+                hwCounters.reset();
+            }
+            /* the final report sends the last interval, then closes the groups */
+            cancelPeriodicTask("hwCounters");
+        }
+        return true;
+    }
+    if (hwCountersEnabled)
+    {
+        setHwCounters(false, events, 0);
+    }
+
+    shared_ptr<hw_counters_session_t> session = make_shared<hw_counters_session_t>();
+    {
+        lock_guard<mutex> lock(hwCountersMutex);
+        /* keep the events this machine can count, virtual machines often have no hardware counters */
+        for (const string& name : events)
+        {
+            const perf_event_type_t *event = findPerfEvent(name);
+            if (event == NULL || session->events.size() == HW_COUNTERS_MAX_EVENTS)
+            {
+                fprintf(stderr, "ERROR: hwCounters cannot count %s\n", name.c_str());
+                continue;
+            }
+            int fd = openCounter(event, 0, -1);
+            if (fd < 0)
+            {
+                fprintf(stderr, "ERROR: %s is not available, check /proc/sys/kernel/perf_event_paranoid\n", name.c_str());
+                continue;
+            }
+            close(fd);
+            session->events.push_back(event);
+        }
+        if (session->events.empty())
+        {
+            return false;
+        }
+
+        /* threads running already that are not Java threads are labelled with their OS name */
+        DIR *tasks = opendir("/proc/self/task");
+        struct dirent *task;
+        while (tasks != NULL && (task = readdir(tasks)) != NULL)
+        {
+            if (task->d_name[0] != '.')
+            {
+                pid_t tid = (pid_t)atoi(task->d_name);
+                java_thread_info_t info;
+                if (!lookupJavaThread(tid, info))
+                {
+                    ifstream commFile(string("/proc/self/task/") + task->d_name + "/comm");
+                    getline(commFile, info.name);
+                }
+                openCounterGroup(*session, tid, info.name);
+            }
+        }
+        if (tasks != NULL)
+        {
+            closedir(tasks);
+        }
+        session->previousReport = chrono::steady_clock::now();
+        hwCounters = session;
+        hwCountersEnabled = true;
+    }
+    schedulePeriodicTask("hwCounters", intervalSeconds, [session](jvmtiEnv *jvmti_env, JNIEnv *jni_env) {
+        reportHwCounters(*session);
+    });
+    return true;
+}
@@ -25,7 +25,10 @@
 #include <string.h>
 
 #include "infra.hpp"
+#include "jitCodeIndex.hpp"
+#include "scheduler.hpp"
 #include "server.hpp"
+#include "threads.hpp"
 
 Server *server = NULL;
 
@@ -75,6 +78,11 @@ JNIEXPORT void JNICALL VMInit(jvmtiEnv *jvmtiEnv, JNIEnv* jni_env, jthread threa
     jvmtiError error;
     int* portPointer = portNo ? &portNo : NULL;
 
+    /* threads started before VMInit posted no ThreadStart event */
+    registerLiveJavaThreads(jvmtiEnv, jni_env);
+    /* and code compiled before the live phase posted no CompiledMethodLoad event */
+    startJitCodeIndex();
+
     server = new Server(portNo, commandsPath, logPath);
 
     error = jvmtiEnv -> RunAgentThread( createNewThread(jni_env),&startServer, portPointer, JVMTI_THREAD_NORM_PRIORITY );
@@ -83,6 +91,8 @@ JNIEXPORT void JNICALL VMInit(jvmtiEnv *jvmtiEnv, JNIEnv* jni_env, jthread threa
 }
 
 JNIEXPORT void JNICALL VMDeath(jvmtiEnv *jvmtiEnv, JNIEnv* jni_env) {
+    /* flush periodic reports while the server can still send them */
+    shutDownScheduler();
     server->shutDownServer();
     delete server;
     printf("VM shutting down.\n");
@@ -0,0 +1,330 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <jvmticmlr.h>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "agentOptions.hpp"
+#include "infra.hpp"
+#include "jitCodeIndex.hpp"
+#include "perfMap.hpp"
+#include "scheduler.hpp"
+
+using namespace std;
+
+/* Everything below is immutable once added to the index, so readers need no lock to
+ * search it; only freeing it must wait for them. */
+
+struct jit_inline_pc_t
+{
+    uint64_t pc;
+    uint32_t firstFrame;
+    uint32_t frameCount;
+};
+
+struct jit_code_t
+{
+    uint64_t start;
+    uint64_t end;
+    jmethodID method;
+    string symbol;
+    vector<jit_inline_pc_t> pcs;        /* by pc, each covers the addresses up to its pc */
+    vector<jit_code_frame_t> frames;    /* frames of every pc, innermost first */
+};
+
+struct jit_code_snapshot_t
+{
+    vector<const jit_code_t *> codes;   /* by start, not overlapping */
+};
+
+struct jit_code_retired_t
+{
+    uint64_t epoch;                     /* readers that entered from this epoch on cannot see it */
+    const jit_code_snapshot_t *snapshot;
+    vector<const jit_code_t *> codes;
+};
+
+static atomic<const jit_code_snapshot_t *> jitCodeSnapshot {new jit_code_snapshot_t()};
+static atomic<uint64_t> jitCodeEpoch {1};
+/* epoch each reader entered in, 0 when it is not reading */
+static atomic<uint64_t> readerEpochs[JIT_CODE_INDEX_READERS];
+static atomic<bool> readerSlotsUsed[JIT_CODE_INDEX_READERS];
+
+/* writers only */
+static mutex jitCodeMutex;
+static map<uint64_t, const jit_code_t *> liveCodes;
+static vector<const jit_code_t *> droppedCodes;
+static vector<jit_code_retired_t> retired;
+static size_t pendingChanges = 0;
+
+/* Frees the snapshots and code no reader can still see. Requires jitCodeMutex. */
+static void reclaimJitCode(void)
+{
+    uint64_t oldestReader = UINT64_MAX;
+    for (int i = 0; i < JIT_CODE_INDEX_READERS; i++)
+    {
+        uint64_t epoch = readerEpochs[i].load();
+        if (epoch != 0)
+        {
+            oldestReader = min(oldestReader, epoch);
+        }
+    }
+
+    auto end = remove_if(retired.begin(), retired.end(), [oldestReader](const jit_code_retired_t& entry) {
+        if (entry.epoch > oldestReader)
+        {
+            return false;
+        }
+        delete entry.snapshot;
+        for (const jit_code_t *code : entry.codes)
+        {
+            delete code;
+        }
+        return true;
+    });
+    retired.erase(end, retired.end());
+}
+
+/* Requires jitCodeMutex */
+static void publishJitCodeLocked(void)
+{
+    if (pendingChanges == 0)
+    {
+        return;
+    }
+
+    jit_code_snapshot_t *snapshot = new jit_code_snapshot_t();
+    snapshot->codes.reserve(liveCodes.size());
+    for (auto& entry : liveCodes)
+    {
+        snapshot->codes.push_back(entry.second);
+    }
+
+    /* a reader that loads the epoch after this increment also loads the new snapshot */
+    const jit_code_snapshot_t *previous = jitCodeSnapshot.exchange(snapshot);
+    uint64_t epoch = jitCodeEpoch.fetch_add(1) + 1;
+    retired.push_back({epoch, previous, move(droppedCodes)});
+    droppedCodes.clear();
+    pendingChanges = 0;
+
+    reclaimJitCode();
+}
+
+/* Requires jitCodeMutex */
+static void changedJitCode(void)
+{
+    pendingChanges++;
+    if (pendingChanges * JIT_CODE_INDEX_BATCH_RATIO >= liveCodes.size())
+    {
+        publishJitCodeLocked();
+    }
+}
+
+/* Requires jitCodeMutex */
+static void dropJitCode(map<uint64_t, const jit_code_t *>::iterator entry)
+{
+    droppedCodes.push_back(entry->second);
+    liveCodes.erase(entry);
+}
+
+static void insertJitCode(jit_code_t *code)
+{
+    lock_guard<mutex> lock(jitCodeMutex);
+
+    auto entry = liveCodes.lower_bound(code->start);
+    if (entry != liveCodes.begin() && prev(entry)->second->end > code->start)
+    {
+        entry--;
+    }
+    while (entry != liveCodes.end() && entry->first < code->end)
+    {
+        dropJitCode(entry++);
+    }
+    liveCodes[code->start] = code;
+    changedJitCode();
+}
+
+/* Copies the inlining records HotSpot style VMs pass with CompiledMethodLoad */
+static void addInlineRecords(jvmtiEnv *jvmtiEnv, jit_code_t *code, const void *compileInfo)
+{
+    unordered_map<jmethodID, string> symbols;
+
+    for (auto header = (const jvmtiCompiledMethodLoadRecordHeader *)compileInfo; header != NULL; header = header->next)
+    {
+        if (header->kind != JVMTI_CMLR_INLINE_INFO)
+        {
+            continue;
+        }
+        auto record = (const jvmtiCompiledMethodLoadInlineRecord *)header;
+        for (jint i = 0; i < record->numpcs; i++)
+        {
+            const PCStackInfo& info = record->pcinfo[i];
+            code->pcs.push_back({(uint64_t)info.pc, (uint32_t)code->frames.size(), (uint32_t)info.numstackframes});
+            for (jint frame = 0; frame < info.numstackframes; frame++)
+            {
+                jmethodID method = info.methods[frame];
+                auto symbol = symbols.find(method);
+                if (symbol == symbols.end())
+                {
+                    symbol = symbols.emplace(method, string()).first;
+                    getJavaMethodSymbol(jvmtiEnv, method, symbol->second);
+                }
+                code->frames.push_back({method, symbol->second, info.bcis[frame]});
+            }
+        }
+    }
+
+    sort(code->pcs.begin(), code->pcs.end(), [](const jit_inline_pc_t& a, const jit_inline_pc_t& b) {
+        return a.pc < b.pc;
+    });
+}
+
+void addJitCode(jvmtiEnv *jvmtiEnv, jmethodID method, const void *address, jint length,
+                const string& symbol, const void *compileInfo)
+{
+    jit_code_t *code = new jit_code_t();
+    code->start = (uint64_t)address;
+    code->end = code->start + length;
+    code->method = method;
+    code->symbol = symbol;
+    if (compileInfo != NULL)
+    {
+        addInlineRecords(jvmtiEnv, code, compileInfo);
+    }
+    insertJitCode(code);
+}
+
+void addJitStub(const void *address, jint length, const char *name)
+{
+    jit_code_t *code = new jit_code_t();
+    code->start = (uint64_t)address;
+    code->end = code->start + length;
+    code->method = NULL;
+    code->symbol = name;
+    insertJitCode(code);
+}
+
+void removeJitCode(const void *address)
+{
+    lock_guard<mutex> lock(jitCodeMutex);
+    auto entry = liveCodes.find((uint64_t)address);
+    if (entry != liveCodes.end())
+    {
+        dropJitCode(entry);
+        changedJitCode();
+    }
+}
+
+void publishJitCode(void)
+{
+    lock_guard<mutex> lock(jitCodeMutex);
+    publishJitCodeLocked();
+}
+
+void startJitCodeIndex(void)
+{
+    jvmtiError error;
+
+    error = jvmti->GenerateEvents(JVMTI_EVENT_DYNAMIC_CODE_GENERATED);
+    check_jvmti_error(jvmti, error, "Unable to generate DynamicCodeGenerated events.");
+    error = jvmti->GenerateEvents(JVMTI_EVENT_COMPILED_METHOD_LOAD);
+    check_jvmti_error(jvmti, error, "Unable to generate CompiledMethodLoad events.");
+
+    schedulePeriodicTask("jitCodeIndex", JIT_CODE_INDEX_PUBLISH_SECONDS, [](jvmtiEnv *jvmti_env, JNIEnv *jni_env) {
+        publishJitCode();
+    });
+}
+
+/* Returns the reader slot of this thread, claiming one on its first lookup, or -1 when all are taken */
+static int getReaderSlot(void)
+{
+    struct reader_slot_t
+    {
+        int index = -1;
+        ~reader_slot_t()
+        {
+            if (index != -1)
+            {
+                readerSlotsUsed[index].store(false);
+            }
+        }
+    };
+    static thread_local reader_slot_t slot;
+
+    for (int i = 0; slot.index == -1 && i < JIT_CODE_INDEX_READERS; i++)
+    {
+        bool used = false;
+        if (readerSlotsUsed[i].compare_exchange_strong(used, true))
+        {
+            slot.index = i;
+        }
+    }
+    return slot.index;
+}
+
+static bool findJitCode(const jit_code_snapshot_t *snapshot, uint64_t address, jit_code_info_t& info)
+{
+    auto next = upper_bound(snapshot->codes.begin(), snapshot->codes.end(), address, [](uint64_t value, const jit_code_t *code) {
+        return value < code->start;
+    });
+    if (next == snapshot->codes.begin() || address >= (*prev(next))->end)
+    {
+        return false;
+    }
+
+    const jit_code_t *code = *prev(next);
+    info.start = code->start;
+    info.end = code->end;
+    info.frames.clear();
+
+    auto pc = lower_bound(code->pcs.begin(), code->pcs.end(), address, [](const jit_inline_pc_t& entry, uint64_t value) {
+        return entry.pc < value;
+    });
+    if (pc != code->pcs.end() && pc->frameCount > 0)
+    {
+        info.frames.assign(code->frames.begin() + pc->firstFrame, code->frames.begin() + pc->firstFrame + pc->frameCount);
+    }
+    else
+    {
+        info.frames.push_back({code->method, code->symbol, -1});
+    }
+    return true;
+}
+
+bool lookupJitCode(uint64_t address, jit_code_info_t& info)
+{
+    int slot = getReaderSlot();
+    if (slot == -1)
+    {
+        lock_guard<mutex> lock(jitCodeMutex);
+        return findJitCode(jitCodeSnapshot.load(), address, info);
+    }
+
+    /* announce the epoch before loading the snapshot so it is not freed while searched */
+    readerEpochs[slot].store(jitCodeEpoch.load());
+    bool found = findJitCode(jitCodeSnapshot.load(), address, info);
+    readerEpochs[slot].store(0);
+    return found;
+}
@@ -27,14 +27,27 @@
 #include "json.hpp"
 #include "server.hpp"
 #include "infra.hpp"
+#include "threads.hpp"
+#include "scheduler.hpp"
+#include "threadLocalCounters.hpp"
 
 #include <iostream>
 #include <atomic>
+#include <algorithm>
+#include <vector>
 
 using json = nlohmann::json;
 
 std::atomic<int> mEntrySampleCount {0};
 std::atomic<int> mEntrySampleRate {1};
+std::atomic<bool> mEntryAggregateEnabled {false};
+
+static ThreadLocalCounters<jmethodID, 1> methodEntryCounts;
+static thread_local ThreadLocalCounters<jmethodID, 1>::Holder methodEntryCountsHolder;
+/* totals when aggregation was started, and at the previous report; only used by the scheduler thread */
+static ThreadLocalCounters<jmethodID, 1>::Totals methodEntryBaseline;
+static ThreadLocalCounters<jmethodID, 1>::Totals methodEntryPrevious;
+static int methodEntryTopN = 20;
 
 /* set sample rate according to command instructions
  * requirement: rate > 0                                */
@@ -42,6 +55,95 @@ void setMethodEntrySampleRate(int rate) {
     mEntrySampleRate = rate;
 }
 
+static uint64_t getMethodEntryCount(const ThreadLocalCounters<jmethodID, 1>::Totals& totals, jmethodID method)
+{
+    auto entry = totals.find(method);
+    return entry != totals.end() ? entry->second[0] : 0;
+}
+
+/* Merges the per-thread counts and sends the most frequently entered methods to the server */
+static void reportMethodEntryCounts(jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv)
+{
+    struct method_count_t
+    {
+        jmethodID method;
+        uint64_t count;
+        uint64_t intervalCount;
+    };
+    std::vector<method_count_t> methods;
+    uint64_t totalEntries = 0, intervalEntries = 0;
+
+    ThreadLocalCounters<jmethodID, 1>::Totals totals = methodEntryCounts.merge();
+    for (auto& entry : totals)
+    {
+        uint64_t count = entry.second[0] - getMethodEntryCount(methodEntryBaseline, entry.first);
+        uint64_t previous = getMethodEntryCount(methodEntryPrevious, entry.first);
+        methods.push_back({entry.first, count, entry.second[0] - previous});
+        totalEntries += count;
+        intervalEntries += entry.second[0] - previous;
+    }
+    methodEntryPrevious = totals;
+
+    size_t n = std::min((size_t)methodEntryTopN, methods.size());
+    std::partial_sort(methods.begin(), methods.begin() + n, methods.end(),
+        [](const method_count_t& a, const method_count_t& b) {
+            return a.count > b.count;
+        });
+
+    auto jMethods = json::array();
+    for (size_t i = 0; i < n; i++)
+    {
+        json jMethod;
+        jvmtiError err;
+        char *name_ptr;
+        char *signature_ptr;
+        char *declaringClassName;
+        jclass declaring_class;
+
+        err = jvmtiEnv->GetMethodName(methods[i].method, &name_ptr, &signature_ptr, NULL);
+        if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Method Name.\n")) {
+            jMethod["methodName"] = name_ptr;
+            jMethod["methodSig"] = signature_ptr;
+            jvmtiEnv->Deallocate((unsigned char*)name_ptr);
+            jvmtiEnv->Deallocate((unsigned char*)signature_ptr);
+        }
+        err = jvmtiEnv->GetMethodDeclaringClass(methods[i].method, &declaring_class);
+        if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Method Declaring Class.\n")) {
+            err = jvmtiEnv->GetClassSignature(declaring_class, &declaringClassName, NULL);
+            if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Method Declaring Class Signature.\n")) {
+                jMethod["methodClass"] = declaringClassName;
+                jvmtiEnv->Deallocate((unsigned char*)declaringClassName);
+            }
+        }
+        jMethod["count"] = methods[i].count;
+        jMethod["intervalCount"] = methods[i].intervalCount;
+        jMethods.push_back(jMethod);
+    }
+
+    json j;
+    j["methodEntryCounts"]["totalEntries"] = totalEntries;
+    j["methodEntryCounts"]["intervalEntries"] = intervalEntries;
+    j["methodEntryCounts"]["distinctMethods"] = methods.size();
+    j["methodEntryCounts"]["methods"] = jMethods;
+    sendToServer(j.dump());
+}
+
+void setMethodEntryAggregate(bool enabled, int topN, int intervalSeconds) {
+    if (enabled) {
+        methodEntryTopN = topN;
+        /* counts are cumulative per thread, so remember where this run starts on the scheduler thread */
+        submitTask([](jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv) {
+            methodEntryBaseline = methodEntryCounts.merge();
+            methodEntryPrevious = methodEntryBaseline;
+        });
+        mEntryAggregateEnabled = true;
+        schedulePeriodicTask("methodEntryCounts", intervalSeconds, &reportMethodEntryCounts);
+    } else if (mEntryAggregateEnabled) {
+        mEntryAggregateEnabled = false;
+        cancelPeriodicTask("methodEntryCounts");
+    }
+}
+
 /* retrieves method name and line number, and declaring class name and signature
  *      for every nth method entry                                                 */
 JNIEXPORT void JNICALL MethodEntry(jvmtiEnv *jvmtiEnv,
@@ -50,6 +152,17 @@ JNIEXPORT void JNICALL MethodEntry(jvmtiEnv *jvmtiEnv,
             jmethodID method) {
 
     int numMethods;
+
+    if (isThreadFiltered(jvmtiEnv, env, thread)) {
+        return;
+    }
+
+    if (mEntryAggregateEnabled) {
+        /* no I/O and no shared writes, the count lands in this thread's own table */
+        methodEntryCounts.add(methodEntryCountsHolder, method, 0, 1);
+        return;
+    }
+
     /* Get number of methods and increment */
     numMethods = atomic_fetch_add(&mEntrySampleCount, 1);
 
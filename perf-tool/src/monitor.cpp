@@ -26,8 +26,10 @@
 #include <ibmjvmti.h>
 #include <map>
 #include "agentOptions.hpp"
+#include "callingContextTree.hpp"
 #include "infra.hpp"
 #include "json.hpp"
+#include "threads.hpp"
 
 //how many times
 using json = nlohmann::json;
@@ -65,6 +67,12 @@ JNIEXPORT void JNICALL MonitorContendedEntered(jvmtiEnv *jvmtiEnv, JNIEnv *env,
     json j;
     jvmtiError error;
     static std::map<const char *, ClassCycleInfo> numContentions;
+
+    if (isThreadFiltered(jvmtiEnv, env, thread))
+    {
+        return;
+    }
+
     jclass cls = env->GetObjectClass(object);
     /* First get the class object */
     jmethodID mid = env->GetMethodID(cls, "getClass", "()Ljava/lang/Class;");
@@ -107,6 +115,7 @@ JNIEXPORT void JNICALL MonitorContendedEntered(jvmtiEnv *jvmtiEnv, JNIEnv *env,
                                           frames, &count);
             if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Stack Trace.") && count >= 1)
             {
+                cctAddSample(jvmtiEnv, thread, CCT_METRIC_CONTENTIONS, 1);
                 char *methodName;
                 err = jvmtiEnv->GetMethodName(frames[0].method,
                                               &methodName, NULL, NULL);
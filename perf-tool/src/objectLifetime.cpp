@@ -0,0 +1,258 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <jvmti.h>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unordered_map>
+#include <vector>
+
+#include "agentOptions.hpp"
+#include "classTags.hpp"
+#include "infra.hpp"
+#include "json.hpp"
+#include "objectalloc.hpp"
+#include "objectLifetime.hpp"
+#include "scheduler.hpp"
+#include "stacks.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+#define LIFETIME_SIZE_SHIFT (LIFETIME_TIME_BITS)
+#define LIFETIME_SITE_SHIFT (LIFETIME_TIME_BITS + LIFETIME_SIZE_BITS)
+#define LIFETIME_MASK(bits) (((jlong)1 << (bits)) - 1)
+
+struct lifetime_site_t
+{
+    /* written once when the site is added, under lifetimeSitesMutex */
+    jlong classTag;
+    jint frameCount;
+    jvmtiFrameInfo frames[OBJECT_ALLOC_STACK_TRACE_NUM_FRAMES];
+
+    atomic<uint64_t> allocated;
+    atomic<uint64_t> freed;
+    atomic<int64_t> liveObjects;
+    atomic<int64_t> liveBytes;
+    atomic<uint64_t> lifetimeHistogram[LIFETIME_HISTOGRAM_BUCKETS];
+};
+
+atomic<bool> objectLifetimeEnabled {false};
+
+static lifetime_site_t lifetimeSites[LIFETIME_SITES_CAPACITY];
+static atomic<uint32_t> lifetimeSiteCount {1};
+static mutex lifetimeSitesMutex;
+static unordered_map<uint64_t, uint32_t> lifetimeSiteIds;   /* (class, stack) hash to site id */
+static uint64_t lifetimeEpochSeconds = 0;
+static int lifetimeTopN = 20;
+
+static inline uint64_t monotonicSeconds(void)
+{
+    /* ObjectFree may not call into the VM, clock_gettime is safe anywhere */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec;
+}
+
+static inline int lifetimeBucket(uint64_t seconds)
+{
+    int bucket = 0;
+    while (seconds > 0 && bucket < LIFETIME_HISTOGRAM_BUCKETS - 1)
+    {
+        seconds >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static uint32_t lifetimeSiteId(jvmtiEnv *jvmtiEnv, jclass objectClass)
+{
+    jvmtiFrameInfo frames[OBJECT_ALLOC_STACK_TRACE_NUM_FRAMES];
+    jint count = 0;
+    jvmtiError err;
+
+    jlong classTag = getClassTag(jvmtiEnv, objectClass);
+    err = jvmtiEnv->GetStackTrace(NULL, 0, OBJECT_ALLOC_STACK_TRACE_NUM_FRAMES, frames, &count);
+    if (err != JVMTI_ERROR_NONE)
+    {
+        count = 0;
+    }
+    uint64_t key = hashStackTrace(frames, count) ^ ((uint64_t)classTag * 0x9E3779B97F4A7C15ULL);
+
+    lock_guard<mutex> lock(lifetimeSitesMutex);
+    auto it = lifetimeSiteIds.find(key);
+    if (it != lifetimeSiteIds.end())
+    {
+        return it->second;
+    }
+    uint32_t id = lifetimeSiteCount.load(memory_order_relaxed);
+    if (id >= LIFETIME_SITES_CAPACITY)
+    {
+        return 0;
+    }
+    lifetime_site_t& site = lifetimeSites[id];
+    site.classTag = classTag;
+    site.frameCount = count;
+    memcpy(site.frames, frames, count * sizeof(jvmtiFrameInfo));
+    lifetimeSiteIds[key] = id;
+    lifetimeSiteCount.store(id + 1, memory_order_release);
+    return id;
+}
+
+void trackObjectLifetime(jvmtiEnv *jvmtiEnv, jobject object, jclass objectClass, jlong size)
+{
+    jlong tag = 0;
+
+    /* class objects and objects already tracked keep their tag */
+    if (jvmtiEnv->GetTag(object, &tag) != JVMTI_ERROR_NONE || tag != 0)
+    {
+        return;
+    }
+
+    uint32_t id = lifetimeSiteId(jvmtiEnv, objectClass);
+    jlong words = min((size + 7) / 8, LIFETIME_MASK(LIFETIME_SIZE_BITS));
+    jlong seconds = (jlong)(monotonicSeconds() - lifetimeEpochSeconds) & LIFETIME_MASK(LIFETIME_TIME_BITS);
+    tag = LIFETIME_TAG_BIT | ((jlong)id << LIFETIME_SITE_SHIFT) | (words << LIFETIME_SIZE_SHIFT) | seconds;
+    if (jvmtiEnv->SetTag(object, tag) != JVMTI_ERROR_NONE)
+    {
+        return;
+    }
+
+    lifetime_site_t& site = lifetimeSites[id];
+    site.allocated.fetch_add(1, memory_order_relaxed);
+    site.liveObjects.fetch_add(1, memory_order_relaxed);
+    site.liveBytes.fetch_add(words * 8, memory_order_relaxed);
+}
+
+JNIEXPORT void JNICALL ObjectFree(jvmtiEnv *jvmtiEnv, jlong tag)
+{
+    if ((tag & LIFETIME_TAG_BIT) == 0)
+    {
+        return;
+    }
+
+    uint32_t id = (uint32_t)((tag >> LIFETIME_SITE_SHIFT) & LIFETIME_MASK(LIFETIME_SITE_BITS));
+    jlong words = (tag >> LIFETIME_SIZE_SHIFT) & LIFETIME_MASK(LIFETIME_SIZE_BITS);
+    jlong allocatedAt = tag & LIFETIME_MASK(LIFETIME_TIME_BITS);
+    jlong now = (jlong)(monotonicSeconds() - lifetimeEpochSeconds) & LIFETIME_MASK(LIFETIME_TIME_BITS);
+    uint64_t age = (uint64_t)((now - allocatedAt) & LIFETIME_MASK(LIFETIME_TIME_BITS));
+
+    if (id >= LIFETIME_SITES_CAPACITY)
+    {
+        return;
+    }
+    lifetime_site_t& site = lifetimeSites[id];
+    site.freed.fetch_add(1, memory_order_relaxed);
+    site.liveObjects.fetch_sub(1, memory_order_relaxed);
+    site.liveBytes.fetch_sub(words * 8, memory_order_relaxed);
+    site.lifetimeHistogram[lifetimeBucket(age)].fetch_add(1, memory_order_relaxed);
+}
+
+json describeLifetimeSite(jvmtiEnv *jvmtiEnv, jint id)
+{
+    json jSite;
+    if (id < 0 || (uint32_t)id >= lifetimeSiteCount.load(memory_order_acquire))
+    {
+        jSite["objType"] = string("unknown");
+        return jSite;
+    }
+    lifetime_site_t& site = lifetimeSites[id];
+    jSite["objType"] = (id == 0) ? string("other") : getClassTagName(site.classTag);
+    jSite["objBackTrace"] = describeStackTrace(jvmtiEnv, site.frames, site.frameCount);
+    return jSite;
+}
+
+static void reportObjectLifetime(jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv)
+{
+    uint32_t siteCount = lifetimeSiteCount.load(memory_order_acquire);
+    vector<uint32_t> ids;
+    int64_t totalLiveObjects = 0;
+    int64_t totalLiveBytes = 0;
+
+    for (uint32_t id = 0; id < siteCount; id++)
+    {
+        totalLiveObjects += lifetimeSites[id].liveObjects.load(memory_order_relaxed);
+        totalLiveBytes += lifetimeSites[id].liveBytes.load(memory_order_relaxed);
+        if (lifetimeSites[id].allocated.load(memory_order_relaxed) > 0)
+        {
+            ids.push_back(id);
+        }
+    }
+    size_t reported = min(ids.size(), (size_t)max(lifetimeTopN, 0));
+    partial_sort(ids.begin(), ids.begin() + reported, ids.end(), [](uint32_t a, uint32_t b) {
+        return lifetimeSites[a].liveBytes.load(memory_order_relaxed) > lifetimeSites[b].liveBytes.load(memory_order_relaxed);
+    });
+
+    auto jSites = json::array();
+    for (size_t i = 0; i < reported; i++)
+    {
+        lifetime_site_t& site = lifetimeSites[ids[i]];
+        json jSite = describeLifetimeSite(jvmtiEnv, ids[i]);
+        jSite["allocated"] = site.allocated.load(memory_order_relaxed);
+        jSite["freed"] = site.freed.load(memory_order_relaxed);
+        jSite["liveObjects"] = site.liveObjects.load(memory_order_relaxed);
+        jSite["liveBytes"] = site.liveBytes.load(memory_order_relaxed);
+        json jHistogram = json::array();
+        for (int b = 0; b < LIFETIME_HISTOGRAM_BUCKETS; b++)
+        {
+            jHistogram.push_back(site.lifetimeHistogram[b].load(memory_order_relaxed));
+        }
+        jSite["lifetimeHistogram"] = jHistogram;
+        jSites.push_back(jSite);
+    }
+
+    json j;
+    j["objectLifetime"]["sampleRate"] = objAllocSampleRate.load();
+    j["objectLifetime"]["trackedSites"] = siteCount - 1;
+    j["objectLifetime"]["liveObjects"] = totalLiveObjects;
+    j["objectLifetime"]["liveBytes"] = totalLiveBytes;
+    j["objectLifetime"]["sites"] = jSites;
+    sendToServer(j.dump());
+}
+
+void setObjectLifetime(bool enabled, int topN, int intervalSeconds)
+{
+    jvmtiError err;
+
+    if (enabled)
+    {
+        if (lifetimeEpochSeconds == 0)
+        {
+            lifetimeEpochSeconds = monotonicSeconds();
+        }
+        lifetimeTopN = topN;
+        err = jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_OBJECT_FREE, (jthread)NULL);
+        check_jvmti_error(jvmti, err, "Unable to enable ObjectFree event notifications.");
+        objectLifetimeEnabled = true;
+        schedulePeriodicTask("objectLifetime", intervalSeconds, &reportObjectLifetime);
+    }
+    else if (objectLifetimeEnabled)
+    {
+        /* ObjectFree stays enabled: tagged objects must still leave the live counts */
+        objectLifetimeEnabled = false;
+        cancelPeriodicTask("objectLifetime");
+    }
+}
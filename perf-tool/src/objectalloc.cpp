@@ -29,6 +29,15 @@
 #include "json.hpp"
 #include "server.hpp"
 #include "infra.hpp"
+#include "threads.hpp"
+#include "callingContextTree.hpp"
+#include "classTags.hpp"
+#include "heavyHitters.hpp"
+#include "objectalloc.hpp"
+#include "objectLifetime.hpp"
+#include "scheduler.hpp"
+#include "stacks.hpp"
+#include "threadLocalCounters.hpp"
 
 #include <iostream>
 #include <chrono>
@@ -38,6 +47,9 @@
 #include <ctime>
 #include <chrono>
 #include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 
 using json = nlohmann::json;
 using namespace std::chrono;
@@ -45,6 +57,59 @@ using namespace std::chrono;
 std::atomic<bool> objAllocBackTraceEnabled {true};
 std::atomic<int> objAllocSampleCount {0};
 std::atomic<int> objAllocSampleRate {1};
+std::atomic<bool> objAllocAggregateEnabled {false};
+std::atomic<bool> objAllocSizesEnabled {false};
+
+struct allocation_site_key_t
+{
+    jlong classTag;
+    uint64_t stackId;
+
+    bool operator==(const allocation_site_key_t& other) const
+    {
+        return classTag == other.classTag && stackId == other.stackId;
+    }
+};
+
+struct allocation_site_key_hash
+{
+    size_t operator()(const allocation_site_key_t& key) const
+    {
+        return (size_t)(key.stackId ^ ((uint64_t)key.classTag * 0x9E3779B97F4A7C15ULL));
+    }
+};
+
+struct allocation_site_t
+{
+    jint frameCount;
+    jvmtiFrameInfo frames[OBJECT_ALLOC_STACK_TRACE_NUM_FRAMES];
+};
+
+static std::mutex allocationSitesMutex;
+static HeavyHitters<allocation_site_key_t, allocation_site_t, allocation_site_key_hash> allocationSites(ALLOCATION_SITES_CAPACITY);
+static uint64_t allocationSiteSamples = 0;
+static int allocationSitesTopN = 20;
+
+/* per class counters: one per size bucket, then the object count and the bytes, then one
+ * per array length bucket, which stay zero for classes that are not arrays */
+#define OBJECT_SIZE_COUNT_COUNTER (OBJECT_SIZE_BUCKETS)
+#define OBJECT_SIZE_BYTES_COUNTER (OBJECT_SIZE_BUCKETS + 1)
+#define OBJECT_LENGTH_FIRST_COUNTER (OBJECT_SIZE_BUCKETS + 2)
+typedef ThreadLocalCounters<jlong, OBJECT_SIZE_BUCKETS + 2 + ARRAY_LENGTH_BUCKETS> ObjectSizeCounters;
+
+struct object_size_report_t
+{
+    steady_clock::time_point time;
+    ObjectSizeCounters::Totals totals;
+};
+
+static ObjectSizeCounters objectSizeCounters;
+static thread_local ObjectSizeCounters::Holder objectSizeCountersHolder;
+/* whether each class tag this thread allocated is an array class, to skip IsArrayClass */
+static thread_local std::unordered_map<jlong, bool> arrayClassCache;
+/* totals of the previous reports, oldest first; only used by the scheduler thread */
+static std::deque<object_size_report_t> objectSizeReports;
+static int objectSizesTopN = 20;
 
 /* Enables or disables the back trace option if sampleRate == 0 */
 void setObjAllocBackTrace(bool val){
@@ -63,7 +128,237 @@ void setObjAllocSampleRate(int rate) {
     return;
 }
 
-/*** retrieves object type name, size (in bytes), allocation rate (bytes/microsec),
+/* Sends the heaviest allocation sites by sampled bytes to the server */
+static void reportAllocationSites(jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv)
+{
+    std::vector<HeavyHitters<allocation_site_key_t, allocation_site_t, allocation_site_key_hash>::Entry> top;
+    uint64_t samples;
+    size_t trackedSites;
+
+    /* copy the sites out so allocating threads are not blocked while names are resolved */
+    {
+        std::lock_guard<std::mutex> lock(allocationSitesMutex);
+        for (auto entry : allocationSites.top(allocationSitesTopN))
+        {
+            top.push_back(*entry);
+        }
+        samples = allocationSiteSamples;
+        trackedSites = allocationSites.size();
+    }
+
+    auto jSites = json::array();
+    for (auto& entry : top)
+    {
+        json jSite;
+        jSite["objType"] = getClassTagName(entry.key.classTag);
+        jSite["samples"] = entry.count;
+        jSite["bytes"] = entry.weight;
+        jSite["bytesError"] = entry.error;
+        jSite["objBackTrace"] = describeStackTrace(jvmtiEnv, entry.value.frames, entry.value.frameCount);
+        jSites.push_back(jSite);
+    }
+
+    json j;
+    j["allocationSites"]["sampleRate"] = objAllocSampleRate.load();
+    j["allocationSites"]["samples"] = samples;
+    j["allocationSites"]["trackedSites"] = trackedSites;
+    j["allocationSites"]["sites"] = jSites;
+    sendToServer(j.dump());
+}
+
+void setObjAllocAggregate(bool enabled, int topN, int intervalSeconds)
+{
+    if (enabled)
+    {
+        {
+            std::lock_guard<std::mutex> lock(allocationSitesMutex);
+            allocationSites.clear();
+            allocationSiteSamples = 0;
+            allocationSitesTopN = topN;
+        }
+        objAllocAggregateEnabled = true;
+        schedulePeriodicTask("allocationSites", intervalSeconds, &reportAllocationSites);
+    }
+    else if (objAllocAggregateEnabled)
+    {
+        objAllocAggregateEnabled = false;
+        cancelPeriodicTask("allocationSites");
+    }
+}
+
+static inline int objectSizeBucket(jlong size)
+{
+    int bucket = 0;
+    while (size > 0 && bucket < OBJECT_SIZE_BUCKETS - 1)
+    {
+        size >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static uint64_t getObjectSizeCounter(const ObjectSizeCounters::Totals& totals, jlong classTag, int counter)
+{
+    auto entry = totals.find(classTag);
+    return entry != totals.end() ? entry->second[counter] : 0;
+}
+
+/* Sends size histograms and allocation rates of the classes allocating the most bytes */
+static void reportObjectSizes(jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv)
+{
+    struct class_bytes_t
+    {
+        jlong classTag;
+        uint64_t intervalBytes;
+    };
+    object_size_report_t current;
+    std::vector<class_bytes_t> classes;
+
+    current.time = steady_clock::now();
+    current.totals = objectSizeCounters.merge();
+    if (objectSizeReports.empty())
+    {
+        objectSizeReports.push_back(std::move(current));
+        return;
+    }
+    const object_size_report_t& previous = objectSizeReports.back();
+    const object_size_report_t& windowStart = objectSizeReports.front();
+    double seconds = duration<double>(current.time - previous.time).count();
+    double windowSeconds = duration<double>(current.time - windowStart.time).count();
+
+    for (auto& entry : current.totals)
+    {
+        uint64_t bytes = entry.second[OBJECT_SIZE_BYTES_COUNTER];
+        classes.push_back({entry.first, bytes - getObjectSizeCounter(previous.totals, entry.first, OBJECT_SIZE_BYTES_COUNTER)});
+    }
+    size_t n = std::min((size_t)objectSizesTopN, classes.size());
+    std::partial_sort(classes.begin(), classes.begin() + n, classes.end(),
+        [](const class_bytes_t& a, const class_bytes_t& b) {
+            return a.intervalBytes > b.intervalBytes;
+        });
+
+    auto jClasses = json::array();
+    for (size_t i = 0; i < n; i++)
+    {
+        const ObjectSizeCounters::Counters& counters = current.totals[classes[i].classTag];
+        uint64_t windowBytes = counters[OBJECT_SIZE_BYTES_COUNTER]
+            - getObjectSizeCounter(windowStart.totals, classes[i].classTag, OBJECT_SIZE_BYTES_COUNTER);
+        json jClass;
+        jClass["objType"] = getClassTagName(classes[i].classTag);
+        jClass["count"] = counters[OBJECT_SIZE_COUNT_COUNTER];
+        jClass["bytes"] = counters[OBJECT_SIZE_BYTES_COUNTER];
+        jClass["intervalBytes"] = classes[i].intervalBytes;
+        jClass["bytesPerSecond"] = seconds > 0 ? classes[i].intervalBytes / seconds : 0.0;
+        jClass["windowBytesPerSecond"] = windowSeconds > 0 ? windowBytes / windowSeconds : 0.0;
+
+        /* [smallest size in the bucket, objects] for the non-empty buckets */
+        auto jHistogram = json::array();
+        for (int b = 0; b < OBJECT_SIZE_BUCKETS; b++)
+        {
+            if (counters[b] > 0)
+            {
+                jHistogram.push_back({b == 0 ? 0 : (uint64_t)1 << (b - 1), counters[b]});
+            }
+        }
+        jClass["sizeHistogram"] = jHistogram;
+
+        /* [smallest length in the bucket, arrays], only array classes count lengths */
+        auto jLengthHistogram = json::array();
+        for (int b = 0; b < ARRAY_LENGTH_BUCKETS; b++)
+        {
+            if (counters[OBJECT_LENGTH_FIRST_COUNTER + b] > 0)
+            {
+                jLengthHistogram.push_back({b == 0 ? 0 : (uint64_t)1 << (b - 1), counters[OBJECT_LENGTH_FIRST_COUNTER + b]});
+            }
+        }
+        if (!jLengthHistogram.empty())
+        {
+            jClass["lengthHistogram"] = jLengthHistogram;
+        }
+        jClasses.push_back(jClass);
+    }
+
+    json j;
+    j["objectSizes"]["intervalSeconds"] = seconds;
+    j["objectSizes"]["windowSeconds"] = windowSeconds;
+    j["objectSizes"]["classes"] = jClasses;
+    sendToServer(j.dump());
+
+    objectSizeReports.push_back(std::move(current));
+    if (objectSizeReports.size() > OBJECT_SIZE_WINDOW_REPORTS)
+    {
+        objectSizeReports.pop_front();
+    }
+}
+
+void setObjAllocSizes(bool enabled, int topN, int intervalSeconds)
+{
+    if (enabled)
+    {
+        objectSizesTopN = topN;
+        /* the window starts over from the current totals, on the scheduler thread */
+        submitTask([](jvmtiEnv *jvmtiEnv, JNIEnv *jniEnv) {
+            objectSizeReports.clear();
+            objectSizeReports.push_back({steady_clock::now(), objectSizeCounters.merge()});
+        });
+        objAllocSizesEnabled = true;
+        schedulePeriodicTask("objectSizes", intervalSeconds, &reportObjectSizes);
+    }
+    else if (objAllocSizesEnabled)
+    {
+        objAllocSizesEnabled = false;
+        cancelPeriodicTask("objectSizes");
+    }
+}
+
+static bool isArrayClass(jvmtiEnv *jvmtiEnv, jlong classTag, jclass klass)
+{
+    auto cached = arrayClassCache.find(classTag);
+    if (cached != arrayClassCache.end())
+    {
+        return cached->second;
+    }
+    jboolean isArray = JNI_FALSE;
+    if (jvmtiEnv->IsArrayClass(klass, &isArray) != JVMTI_ERROR_NONE)
+    {
+        return false;
+    }
+    arrayClassCache[classTag] = (isArray == JNI_TRUE);
+    return isArray == JNI_TRUE;
+}
+
+/* Counts a sampled allocation against its (class, stack) site without sending anything */
+static void aggregateObjectAlloc(jvmtiEnv *jvmtiEnv, jclass object_klass, jlong size)
+{
+    jvmtiError err;
+    allocation_site_key_t key;
+    jvmtiFrameInfo frames[OBJECT_ALLOC_STACK_TRACE_NUM_FRAMES];
+    jint count = 0;
+    bool isNew;
+
+    key.classTag = getClassTag(jvmtiEnv, object_klass);
+    if (objAllocBackTraceEnabled)
+    {
+        err = jvmtiEnv->GetStackTrace(NULL, 0, OBJECT_ALLOC_STACK_TRACE_NUM_FRAMES, frames, &count);
+        if (!check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Stack Trace.\n"))
+        {
+            count = 0;
+        }
+    }
+    key.stackId = hashStackTrace(frames, count);
+    cctAddSample(jvmtiEnv, NULL, CCT_METRIC_BYTES, (uint64_t)size);
+
+    std::lock_guard<std::mutex> lock(allocationSitesMutex);
+    allocationSiteSamples++;
+    auto& site = allocationSites.add(key, (uint64_t)size, isNew);
+    if (isNew)
+    {
+        site.value.frameCount = count;
+        memcpy(site.value.frames, frames, count * sizeof(jvmtiFrameInfo));
+    }
+}
+
+/*** retrieves object type name, size (in bytes),
  *      and backtrace for every nth sample (if enabled)                             ***/
 JNIEXPORT void JNICALL VMObjectAlloc(jvmtiEnv *jvmtiEnv,
                         JNIEnv* env,
@@ -73,10 +368,41 @@ JNIEXPORT void JNICALL VMObjectAlloc(jvmtiEnv *jvmtiEnv,
                         jlong size) {
     jvmtiError err;
 
+    if (isThreadFiltered(jvmtiEnv, env, thread)) {
+        return;
+    }
+
+    if (objAllocSizesEnabled) {
+        /* every allocation, lock free: the counters land in this thread's own table */
+        jlong classTag = getClassTag(jvmtiEnv, object_klass);
+        if (classTag != 0) {
+            objectSizeCounters.add(objectSizeCountersHolder, classTag, objectSizeBucket(size), 1);
+            objectSizeCounters.add(objectSizeCountersHolder, classTag, OBJECT_SIZE_COUNT_COUNTER, 1);
+            objectSizeCounters.add(objectSizeCountersHolder, classTag, OBJECT_SIZE_BYTES_COUNTER, (uint64_t)size);
+            if (isArrayClass(jvmtiEnv, classTag, object_klass)) {
+                jsize length = env->GetArrayLength((jarray)object);
+                objectSizeCounters.add(objectSizeCountersHolder, classTag, OBJECT_LENGTH_FIRST_COUNTER + objectSizeBucket(length), 1);
+            }
+        }
+    }
+
+    if (objectLifetimeEnabled) {
+        if (atomic_fetch_add(&objAllocSampleCount, 1) % objAllocSampleRate == 0) {
+            trackObjectLifetime(jvmtiEnv, object, object_klass, size);
+        }
+        return;
+    }
+
+    if (objAllocAggregateEnabled) {
+        /* only every nth allocation pays for a stack walk, the rest are not counted */
+        if (atomic_fetch_add(&objAllocSampleCount, 1) % objAllocSampleRate == 0) {
+            aggregateObjectAlloc(jvmtiEnv, object_klass, size);
+        }
+        return;
+    }
+
     json jObj;
     char *classType;
-    auto start = steady_clock::now();
-
 
     int numObjects;
 
@@ -88,7 +414,7 @@ JNIEXPORT void JNICALL VMObjectAlloc(jvmtiEnv *jvmtiEnv,
     err = jvmtiEnv->GetClassSignature(object_klass, &classType, NULL);
     if (classType != NULL && check_jvmti_error(jvmtiEnv, err, "Unable to retrive Object Class.\n")) {
         jObj["objType"] = classType;
-        jObj["size"] = (jint)size;    
+        jObj["size"] = size;
         err = jvmtiEnv->Deallocate((unsigned char*)classType);
         check_jvmti_error(jvmtiEnv, err, "Unable to deallocate classType.\n");
     }
@@ -97,7 +423,7 @@ JNIEXPORT void JNICALL VMObjectAlloc(jvmtiEnv *jvmtiEnv,
     /*** retrieves method names and line numbers, and declaring class name and signature ***/
     if (objAllocBackTraceEnabled) {
         if (numObjects % objAllocSampleRate == 0){
-            int numFrames = 10;
+            int numFrames = OBJECT_ALLOC_STACK_TRACE_NUM_FRAMES;
             jvmtiFrameInfo frames[numFrames];
             jint count;
             int i;
@@ -105,6 +431,7 @@ JNIEXPORT void JNICALL VMObjectAlloc(jvmtiEnv *jvmtiEnv,
             auto jMethods = json::array();
             err = jvmtiEnv->GetStackTrace(NULL, 0, numFrames, frames, &count);
             if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Stack Trace.\n") && count >= 1) {
+                cctAddSample(jvmtiEnv, NULL, CCT_METRIC_BYTES, (uint64_t)size);
                 char *methodName;
                 char *methodSignature;
                 char *declaringClassName;
@@ -148,12 +475,6 @@ JNIEXPORT void JNICALL VMObjectAlloc(jvmtiEnv *jvmtiEnv,
         objAllocSampleCount = atomic_fetch_add(&objAllocSampleCount, 1);
     }
 
-    /*** calculate time taken in microseconds and calculate rate ***/
-    auto end = steady_clock::now();
-    auto duration = duration_cast<microseconds>(end - start).count();
-    float rate = (float)size/duration;
-    jObj["objAllocRate"] = rate;
-
     json j;
     j["object"] = jObj; 
     std::string s = j.dump(2, ' ', true);
@@ -25,125 +25,179 @@
 #include <unistd.h>
 #include <string>
 #include <perf.hpp>
+#include <perfData.hpp>
+#include <perfProfile.hpp>
+#include <perfSession.hpp>
 #include <signal.h>
 #include <stdio.h>
 #include <sys/wait.h>
 #include <fcntl.h>
-#include <regex>
 #include <fstream>
 #include <infra.hpp>
 #include <limits.h>
+#include <chrono>
+#include <errno.h>
+#include <poll.h>
+#include <spawn.h>
+#include <vector>
 
 using namespace std;
 
 
-/* For use later if user specifies which fields to return */
-const perfFieldRegex mapRegex[PERF_FIELD_MAX] = {
-    {"unknown", "(.*)"},                        // PERF_FIELD_UNKNOWN
-    {"prog", "\\s+(.+)"},                       // PERF_FIELD_PROG
-    {"pid", "\\s+([0-9]+)"},                    // PERF_FIELD_PID
-    {"cpu", "\\s+([^\\s]+)"},                   // PERF_FIELD_CPU
-    {"time", "\\s+([^\\s]+):"},                 // PERF_FIELD_TIME
-    {"cycles", "\\s+([^\\s]+)\\s+cycles:"},     // PERF_FIELD_CYCLES
-    {"address", "\\s+([^\\s]+)"},               // PERF_FIELD_ADDRESS
-    {"instruction", "\\s+([^\\s]+)"},           // PERF_FIELD_INSTRUCTION
-    {"path", "\\s+([^\\s]+)"},                  // PERF_FIELD_PATH
+const char *const perfFieldNames[PERF_FIELD_MAX] = {
+    "unknown",          // PERF_FIELD_UNKNOWN
+    "prog",             // PERF_FIELD_PROG
+    "pid",              // PERF_FIELD_PID
+    "tid",              // PERF_FIELD_TID
+    "cpu",              // PERF_FIELD_CPU
+    "time",             // PERF_FIELD_TIME
+    "event",            // PERF_FIELD_EVENT
+    "cycles",           // PERF_FIELD_CYCLES
+    "ip",               // PERF_FIELD_ADDRESS
+    "symbol+offset",    // PERF_FIELD_INSTRUCTION
+    "dso",              // PERF_FIELD_PATH
 };
 
+const char *const perfOptionNames[PERF_OPTION_MAX] = {
+    "unknown",          // PERF_OPTION_UNKNOWN
+    "pid",              // PERF_OPTION_PID
+    "time",             // PERF_OPTION_REC_TIME
+    "fields",           // PERF_OPTION_FIELDS
+    "session",          // PERF_OPTION_SESSION
+    "events",           // PERF_OPTION_EVENTS
+    "frequency",        // PERF_OPTION_FREQUENCY
+    "callGraph",        // PERF_OPTION_CALL_GRAPH
+    "interval",         // PERF_OPTION_INTERVAL
+    "output",           // PERF_OPTION_OUTPUT
+    "backend",          // PERF_OPTION_BACKEND
+    "file",             // PERF_OPTION_FILE
+};
 
-void perfProcess(pid_t processID, int recordTime) {
-    /* Perf process runs perf tool to collect perf data of given process.
-    * Inputs:	pid_t 	processID:	process ID of running application.
-    * Outputs:	json	perf_data:	perf data collected from application.
-    * */
 
+/* Starts args with its working directory set to dir, and stdin and stdout redirected
+ * when the fds are not -1. posix_spawn does not copy the JVM's address space like fork. */
+static pid_t spawnPerf(char *const args[], const char *dir, int stdinFd, int stdoutFd) {
+    posix_spawn_file_actions_t actions;
     pid_t pid;
-    int fd, status;
-    string pidStr = to_string(processID); // define unique id for each line
-    char currDir[PATH_MAX];
-    char* pidCharArr = (char*)pidStr.c_str();
-    char* perfPath = (char*)"/usr/bin/perf";
-    char* perfRecord = (char*)"record";
-    char* perfPidFlag = (char*)"-p";
-    char *args[5] = {perfPath, perfRecord, perfPidFlag, pidCharArr, NULL};
-
-    // Save current directory to return to later
-    if (getcwd(currDir, PATH_MAX) == NULL) {
-        perror("getcwd");
-        return;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addchdir_np(&actions, dir);
+    if (stdinFd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, stdinFd, STDIN_FILENO);
+    }
+    if (stdoutFd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, stdoutFd, STDOUT_FILENO);
     }
+    int rc = posix_spawn(&pid, args[0], &actions, NULL, args, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+        errno = rc;
+        perror("posix_spawn");
+        return -1;
+    }
+    return pid;
+}
 
-    // Change to /tmp folder to store the perf data
-    if (chdir("/tmp") == -1) {
-        perror("chdir");
-        return;
+void perfProcess(const perf_session_config_t& config, const atomic<bool>& cancelled) {
+    /* Perf process runs perf tool to collect perf data of given process.
+    * perf record writes perf.data in pipe format, which is decoded by PerfDataReader
+    * while recording is in progress. Nothing is written to the file system; perf record
+    * runs in a private temporary directory so the JVM's working directory is left alone.
+    * Inputs:	config:	    process ID, events, frequency, seconds to record for (0 until
+    *                       cancelled) and output options of the session.
+    *           cancelled:  set to stop recording early.
+    * */
+    string events;
+    for (const string& event : config.events) {
+        events += (events.empty() ? "" : ",") + event;
     }
+    vector<string> recordArgStrings = {"/usr/bin/perf", "record", "-o", "-", "-p", to_string(config.pid),
+                                       "-e", events, "-F", to_string(config.frequency)};
+    if (config.output.callGraph) {
+        recordArgStrings.push_back("-g");
+    }
+    vector<char*> recordArgs;
+    for (string& arg : recordArgStrings) {
+        recordArgs.push_back((char*)arg.c_str());
+    }
+    recordArgs.push_back(NULL);
+
+    char sessionDir[] = "/tmp/perf-agent-XXXXXX";
+    int recordPipe[2];
+    pid_t recordPid;
+    int status;
 
-    if ((pid = fork()) == -1) {
-        perror("fork");
+    if (mkdtemp(sessionDir) == NULL) {
+        perror("mkdtemp");
+        return;
+    }
+    if (pipe2(recordPipe, O_CLOEXEC) == -1) {
+        perror("pipe");
+        rmdir(sessionDir);
         return;
     }
 
-    if (pid == 0) {
-        // Child process: Run perf record to collect process data into perf.data
-        if (execv(args[0], args) == -1) {
-            perror("execv");
-            return;
+    recordPid = spawnPerf(recordArgs.data(), sessionDir, -1, recordPipe[1]);
+    close(recordPipe[1]);
+
+    PerfProfile profile(config.output);
+    PerfSymbolizer& symbolizer = profile.getSymbolizer();
+    PerfDataReader reader(
+        [&profile](const perf_sample_t& sample) { profile.addSample(sample); },
+        [&symbolizer](const perf_data_mmap_t& mapping) { symbolizer.addMapping(mapping); },
+        [&symbolizer](uint32_t pid, uint32_t tid, const char *comm) { symbolizer.setComm(tid, comm); });
+
+    // Decode perf record output as it arrives, and stop perf record after recordTime or when cancelled
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(config.recordTime > 0 ? config.recordTime : INT_MAX);
+    bool recording = (recordPid != -1);
+    char buffer[65536];
+
+    while (recordPid != -1) {
+        if (recording) {
+            auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+            struct pollfd pollFd = {recordPipe[0], POLLIN, 0};
+            if (remaining <= 0 || cancelled) {
+                kill(recordPid, SIGTERM);
+                recording = false;
+                continue;
+            }
+            profile.poll();
+            if (poll(&pollFd, 1, (int)min<long long>(remaining, PERF_SAMPLER_POLL_MILLIS)) <= 0) {
+                continue;
+            }
+        }
+        ssize_t length = read(recordPipe[0], buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0 || !reader.feed(buffer, length)) {
+            break;
         }
     }
+    close(recordPipe[0]);
 
-    // Parent process sleeps for recordTime before sending terminate signal to child
-    sleep(recordTime);
-    kill(pid, SIGTERM);
-    pid = wait(&status);
-    system("perf script > perf.data.txt");
-
-    ifstream file("perf.data.txt");
-    string lineStr;
-    int idCount = 0;
-    while (getline(file, lineStr)) {
-        // Process str
-        // Parse perf.data.txt using regex to get data for each process
-        smatch matches;
-
-        // To-do: make this into string array that is indexed by enum (enum containing options)
-        string progExpression ("\\s+(.+)");
-        string pidExpression ("\\s+([0-9]+)");
-        string cpuExpression ("\\s+([^\\s]+)");
-        string timeExpression ("\\s+([^\\s]+):");
-        string cyclesExpression ("\\s+([^\\s]+)\\s+cycles:");
-        string addressExpression ("\\s+([^\\s]+)");
-        string instructionExpression ("\\s+([^\\s]+)");
-        string pathExpression ("\\s+([^\\s]+)");
-
-        regex expression (progExpression + pidExpression + timeExpression + cyclesExpression + addressExpression + instructionExpression + pathExpression + "$");
-
-        if (regex_search(lineStr, matches, expression)) {
-            // Save into json format
-            json perfData;
-
-            // Put into JSON object
-            string idStr = to_string(idCount); // define unique id for each line
-            perfData["id"] = idStr.c_str();
-            perfData["prog"] = matches[1].str().c_str();
-            perfData["pid"] = matches[2].str().c_str();
-            perfData["time"] = matches[3].str().c_str();
-            perfData["cycles"] = matches[4].str().c_str();
-            perfData["ip"] = matches[5].str().c_str();
-            perfData["symbol+offset"] = matches[6].str().c_str();
-            perfData["dso"] = matches[7].str().c_str();
-            perfData["record"] = lineStr.c_str();
-            idCount++;
-
-            sendToServer(perfData.dump());
+    if (recordPid != -1) {
+        if (recording) {
+            kill(recordPid, SIGTERM);
         }
-
+        waitpid(recordPid, &status, 0);
+        profile.finish(reader.getSampleCount(), reader.getLostCount());
+    }
+    if (rmdir(sessionDir) == -1) {
+        perror("rmdir");
     }
+}
 
-    // Restore working directory
-    if (chdir(currDir) == -1) {
-        perror("chdir");
-        return;
+void perfDecodeFile(const perf_session_config_t& config) {
+    /* Sends the samples of a perf.data file recorded earlier, in file or pipe format */
+    PerfProfile profile(config.output);
+    PerfSymbolizer& symbolizer = profile.getSymbolizer();
+    PerfDataReader reader(
+        [&profile](const perf_sample_t& sample) { profile.addSample(sample); },
+        [&symbolizer](const perf_data_mmap_t& mapping) { symbolizer.addMapping(mapping); },
+        [&symbolizer](uint32_t pid, uint32_t tid, const char *comm) { symbolizer.setComm(tid, comm); });
+
+    if (reader.readFile(config.file.c_str())) {
+        profile.finish(reader.getSampleCount(), reader.getLostCount());
     }
-    // return perfData;
 }
@@ -0,0 +1,188 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "infra.hpp"
+#include "json.hpp"
+#include "perf.hpp"
+#include "perfData.hpp"
+#include "perfProfile.hpp"
+#include "threads.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+PerfSymbolizer::PerfSymbolizer()
+{
+    selfPid = getpid();
+}
+
+const char *PerfSymbolizer::intern(const char *name)
+{
+    return names.insert(name).first->c_str();
+}
+
+void PerfSymbolizer::addMapping(const perf_data_mmap_t& mapping)
+{
+    mappings[mapping.pid][mapping.address] = {mapping.address + mapping.length, mapping.pageOffset, intern(mapping.fileName)};
+}
+
+void PerfSymbolizer::setComm(uint32_t tid, const char *comm)
+{
+    comms[tid] = intern(comm);
+}
+
+const char *PerfSymbolizer::getComm(uint32_t tid) const
+{
+    auto comm = comms.find(tid);
+    return (comm == comms.end()) ? NULL : comm->second;
+}
+
+perf_symbol_t PerfSymbolizer::resolve(uint32_t pid, uint64_t ip)
+{
+    perf_symbol_t resolved = {NULL, 0, NULL};
+    Dl_info info;
+
+    if ((pid_t)pid == selfPid)
+    {
+        /* only dladdr results are cached, mappings can still change */
+        auto cached = cache.find(ip);
+        if (cached != cache.end())
+        {
+            resolved = cached->second;
+        }
+        else
+        {
+            if (dladdr((void *)ip, &info) != 0)
+            {
+                if (info.dli_sname != NULL)
+                {
+                    resolved.symbol = intern(info.dli_sname);
+                    resolved.offset = ip - (uint64_t)info.dli_saddr;
+                }
+                else
+                {
+                    resolved.offset = ip - (uint64_t)info.dli_fbase;
+                }
+                resolved.dso = intern(info.dli_fname);
+            }
+            if (cache.size() >= PERF_SYMBOL_CACHE_ENTRIES)
+            {
+                cache.clear();
+            }
+            cache[ip] = resolved;
+        }
+    }
+
+    if (resolved.dso == NULL && (pid_t)pid == selfPid && lookupJitCode(ip, jitCode))
+    {
+        /* name the innermost method when the code was inlined; JIT code is not cached, its memory is reused */
+        resolved.symbol = intern(jitCode.frames[0].symbol.c_str());
+        resolved.offset = ip - jitCode.start;
+        resolved.dso = intern(PERF_JIT_DSO);
+    }
+
+    if (resolved.dso == NULL)
+    {
+        /* other processes: name the mapping only */
+        auto pidMappings = mappings.find(pid);
+        if (pidMappings != mappings.end())
+        {
+            auto mapping = pidMappings->second.upper_bound(ip);
+            if (mapping != pidMappings->second.begin())
+            {
+                mapping--;
+                if (ip < mapping->second.end)
+                {
+                    resolved.dso = mapping->second.dso;
+                    resolved.offset = ip - mapping->first + mapping->second.pageOffset;
+                }
+            }
+        }
+    }
+
+    return resolved;
+}
+
+void sendPerfSample(const perf_sample_t& sample, uint64_t id, PerfSymbolizer& symbolizer, const perf_output_options_t& options)
+{
+    json perfData;
+    char buffer[32];
+    const char *comm = symbolizer.getComm(sample.tid);
+    perf_symbol_t symbol = symbolizer.resolve(sample.pid, sample.ip);
+    auto selected = [&options](perfField_t field) { return (options.fields & (1u << field)) != 0; };
+
+    perfData["id"] = id;
+    perfData["session"] = options.session;
+    if (selected(PERF_FIELD_PROG) && comm != NULL)
+    {
+        perfData[perfFieldNames[PERF_FIELD_PROG]] = comm;
+    }
+    if (selected(PERF_FIELD_PID))
+    {
+        perfData[perfFieldNames[PERF_FIELD_PID]] = sample.pid;
+    }
+    if (selected(PERF_FIELD_TID))
+    {
+        java_thread_info_t thread;
+        perfData[perfFieldNames[PERF_FIELD_TID]] = sample.tid;
+        if ((pid_t)sample.pid == getpid() && lookupJavaThread((pid_t)sample.tid, thread))
+        {
+            perfData["javaThread"] = thread.name;
+            perfData["threadGroup"] = thread.group;
+        }
+    }
+    if (selected(PERF_FIELD_CPU) && sample.cpu != PERF_SAMPLE_NO_CPU)
+    {
+        perfData[perfFieldNames[PERF_FIELD_CPU]] = sample.cpu;
+    }
+    if (selected(PERF_FIELD_TIME))
+    {
+        perfData[perfFieldNames[PERF_FIELD_TIME]] = sample.time;
+    }
+    if (selected(PERF_FIELD_EVENT) && sample.event != NULL)
+    {
+        perfData[perfFieldNames[PERF_FIELD_EVENT]] = sample.event;
+    }
+    if (selected(PERF_FIELD_CYCLES))
+    {
+        perfData[perfFieldNames[PERF_FIELD_CYCLES]] = sample.period;
+    }
+    if (selected(PERF_FIELD_ADDRESS))
+    {
+        snprintf(buffer, sizeof(buffer), "%llx", (unsigned long long)sample.ip);
+        perfData[perfFieldNames[PERF_FIELD_ADDRESS]] = buffer;
+    }
+    if (selected(PERF_FIELD_INSTRUCTION) && symbol.symbol != NULL)
+    {
+        snprintf(buffer, sizeof(buffer), "+0x%llx", (unsigned long long)symbol.offset);
+        perfData[perfFieldNames[PERF_FIELD_INSTRUCTION]] = string(symbol.symbol) + buffer;
+    }
+    if (selected(PERF_FIELD_PATH) && symbol.dso != NULL)
+    {
+        perfData[perfFieldNames[PERF_FIELD_PATH]] = symbol.dso;
+    }
+    sendToServer(perfData.dump());
+}
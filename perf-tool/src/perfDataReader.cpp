@@ -0,0 +1,430 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "perfDataReader.hpp"
+
+using namespace std;
+
+PerfDataReader::PerfDataReader(function<void(const perf_sample_t&)> _onSample,
+                               function<void(const perf_data_mmap_t&)> _onMmap,
+                               function<void(uint32_t pid, uint32_t tid, const char *comm)> _onComm)
+    : onSample(_onSample), onMmap(_onMmap), onComm(_onComm)
+{
+}
+
+void PerfDataReader::addAttr(const uint8_t *attr, size_t length, const uint64_t *ids, size_t idCount)
+{
+    attr_t entry;
+
+    /* older and newer perf versions write shorter or longer attributes than ours */
+    memset(&entry.attr, 0, sizeof(entry.attr));
+    memcpy(&entry.attr, attr, min(length, sizeof(entry.attr)));
+    entry.event = getPerfEventName(entry.attr.type, entry.attr.config);
+    entry.ids.assign(ids, ids + idCount);
+    attrs.push_back(entry);
+}
+
+const PerfDataReader::attr_t *PerfDataReader::findAttr(const uint8_t *body, size_t length) const
+{
+    if (attrs.size() <= 1)
+    {
+        return attrs.empty() ? NULL : &attrs[0];
+    }
+
+    /* with several events perf sets PERF_SAMPLE_IDENTIFIER, which comes first in every sample */
+    uint64_t id;
+    if (!(attrs[0].attr.sample_type & PERF_SAMPLE_IDENTIFIER) || length < sizeof(id))
+    {
+        return &attrs[0];
+    }
+    memcpy(&id, body, sizeof(id));
+    for (const attr_t& attr : attrs)
+    {
+        for (uint64_t attrId : attr.ids)
+        {
+            if (attrId == id)
+            {
+                return &attr;
+            }
+        }
+    }
+    return NULL;
+}
+
+void PerfDataReader::decodeSample(const uint8_t *record, size_t size)
+{
+    const uint8_t *p = record + sizeof(struct perf_event_header);
+    const uint8_t *end = record + size;
+    const attr_t *attr = findAttr(p, end - p);
+    perf_sample_t sample;
+    uint64_t value;
+
+    if (attr == NULL)
+    {
+        return;
+    }
+    uint64_t sampleType = attr->attr.sample_type;
+    uint64_t readFormat = attr->attr.read_format;
+
+    memset(&sample, 0, sizeof(sample));
+    sample.event = attr->event;
+    sample.cpu = PERF_SAMPLE_NO_CPU;
+
+    /* fields are in the order of the PERF_RECORD_SAMPLE description in perf_event.h */
+    auto next = [&p, end](uint64_t& field) {
+        if (p + sizeof(field) > end)
+        {
+            return false;
+        }
+        memcpy(&field, p, sizeof(field));
+        p += sizeof(field);
+        return true;
+    };
+    if ((sampleType & PERF_SAMPLE_IDENTIFIER) && !next(value))
+    {
+        return;
+    }
+    if ((sampleType & PERF_SAMPLE_IP) && !next(sample.ip))
+    {
+        return;
+    }
+    if (sampleType & PERF_SAMPLE_TID)
+    {
+        if (!next(value))
+        {
+            return;
+        }
+        sample.pid = (uint32_t)value;
+        sample.tid = (uint32_t)(value >> 32);
+    }
+    if ((sampleType & PERF_SAMPLE_TIME) && !next(sample.time))
+    {
+        return;
+    }
+    if ((sampleType & PERF_SAMPLE_ADDR) && !next(value))
+    {
+        return;
+    }
+    if ((sampleType & PERF_SAMPLE_ID) && !next(value))
+    {
+        return;
+    }
+    if ((sampleType & PERF_SAMPLE_STREAM_ID) && !next(value))
+    {
+        return;
+    }
+    if (sampleType & PERF_SAMPLE_CPU)
+    {
+        if (!next(value))
+        {
+            return;
+        }
+        sample.cpu = (uint32_t)value;
+    }
+    if ((sampleType & PERF_SAMPLE_PERIOD) && !next(sample.period))
+    {
+        return;
+    }
+    if (sampleType & PERF_SAMPLE_READ)
+    {
+        /* skip the counter values, their layout depends on read_format */
+        uint64_t perValue = 1 + ((readFormat & PERF_FORMAT_ID) ? 1 : 0) + ((readFormat & PERF_FORMAT_LOST) ? 1 : 0);
+        uint64_t times = ((readFormat & PERF_FORMAT_TOTAL_TIME_ENABLED) ? 1 : 0) + ((readFormat & PERF_FORMAT_TOTAL_TIME_RUNNING) ? 1 : 0);
+        uint64_t words = perValue + times;
+        if (readFormat & PERF_FORMAT_GROUP)
+        {
+            if (!next(value))
+            {
+                return;
+            }
+            words = times + value * perValue;
+        }
+        if ((uint64_t)(end - p) < words * sizeof(uint64_t))
+        {
+            return;
+        }
+        p += words * sizeof(uint64_t);
+    }
+    if (sampleType & PERF_SAMPLE_CALLCHAIN)
+    {
+        if (!next(value) || (uint64_t)(end - p) / sizeof(uint64_t) < value)
+        {
+            return;
+        }
+        /* records are 8 byte aligned in the file and in pending */
+        sample.callchainLength = value;
+        sample.callchain = (const uint64_t *)p;
+    }
+
+    samples++;
+    onSample(sample);
+}
+
+uint64_t PerfDataReader::handleRecord(const uint8_t *record, size_t size)
+{
+    struct perf_event_header header;
+    const uint8_t *body = record + sizeof(header);
+    size_t bodySize = size - sizeof(header);
+    uint32_t pidTid[2];
+
+    memcpy(&header, record, sizeof(header));
+    switch (header.type)
+    {
+    case PERF_RECORD_SAMPLE:
+        decodeSample(record, size);
+        break;
+    case PERF_RECORD_MMAP:
+    case PERF_RECORD_MMAP2:
+    {
+        /* MMAP2 adds device, inode (or build id) and protection fields before the name */
+        size_t nameOffset = sizeof(pidTid) + 3 * sizeof(uint64_t);
+        if (header.type == PERF_RECORD_MMAP2)
+        {
+            nameOffset += 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t);
+        }
+        if (onMmap && bodySize > nameOffset && memchr(body + nameOffset, '\0', bodySize - nameOffset) != NULL)
+        {
+            perf_data_mmap_t mapping;
+            memcpy(pidTid, body, sizeof(pidTid));
+            mapping.pid = pidTid[0];
+            mapping.tid = pidTid[1];
+            memcpy(&mapping.address, body + sizeof(pidTid), sizeof(uint64_t));
+            memcpy(&mapping.length, body + sizeof(pidTid) + sizeof(uint64_t), sizeof(uint64_t));
+            memcpy(&mapping.pageOffset, body + sizeof(pidTid) + 2 * sizeof(uint64_t), sizeof(uint64_t));
+            mapping.fileName = (const char *)body + nameOffset;
+            onMmap(mapping);
+        }
+        break;
+    }
+    case PERF_RECORD_COMM:
+        if (onComm && bodySize > sizeof(pidTid) && memchr(body + sizeof(pidTid), '\0', bodySize - sizeof(pidTid)) != NULL)
+        {
+            memcpy(pidTid, body, sizeof(pidTid));
+            onComm(pidTid[0], pidTid[1], (const char *)body + sizeof(pidTid));
+        }
+        break;
+    case PERF_RECORD_LOST:
+        if (bodySize >= 2 * sizeof(uint64_t))
+        {
+            uint64_t lost;
+            memcpy(&lost, body + sizeof(uint64_t), sizeof(lost));
+            lostSamples += lost;
+        }
+        break;
+    case PERF_DATA_RECORD_HEADER_ATTR:
+        if (bodySize >= 2 * sizeof(uint32_t))
+        {
+            /* the attribute is followed by the ids of its events up to the end of the record */
+            uint32_t attrSize;
+            memcpy(&attrSize, body + sizeof(uint32_t), sizeof(attrSize));
+            attrSize = (attrSize == 0) ? PERF_ATTR_SIZE_VER0 : attrSize;
+            if (attrSize <= bodySize)
+            {
+                addAttr(body, attrSize, (const uint64_t *)(body + attrSize), (bodySize - attrSize) / sizeof(uint64_t));
+            }
+        }
+        break;
+    case PERF_DATA_RECORD_HEADER_TRACING_DATA:
+        /* the tracepoint formats follow the record, padded to 8 bytes */
+        if (bodySize >= sizeof(uint32_t))
+        {
+            uint32_t dataSize;
+            memcpy(&dataSize, body, sizeof(dataSize));
+            return dataSize;
+        }
+        break;
+    case PERF_DATA_RECORD_AUXTRACE:
+        if (bodySize >= sizeof(uint64_t))
+        {
+            uint64_t dataSize;
+            memcpy(&dataSize, body, sizeof(dataSize));
+            return dataSize;
+        }
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+bool PerfDataReader::readPipeHeader(const uint8_t *data, size_t length)
+{
+    perf_data_file_header_t header;
+
+    memcpy(&header, data, PERF_DATA_PIPE_HEADER_SIZE);
+    if (header.magic != PERF_DATA_MAGIC)
+    {
+        fprintf(stderr, "ERROR: not perf data in host byte order\n");
+        return false;
+    }
+    if (header.size != PERF_DATA_PIPE_HEADER_SIZE)
+    {
+        fprintf(stderr, "ERROR: perf data stream is not in pipe format\n");
+        return false;
+    }
+    return true;
+}
+
+bool PerfDataReader::feed(const void *data, size_t length)
+{
+    size_t offset = 0;
+
+    if (failed)
+    {
+        return false;
+    }
+    pending.insert(pending.end(), (const uint8_t *)data, (const uint8_t *)data + length);
+
+    if (!headerRead)
+    {
+        if (pending.size() < PERF_DATA_PIPE_HEADER_SIZE)
+        {
+            return true;
+        }
+        if (!readPipeHeader(pending.data(), pending.size()))
+        {
+            failed = true;
+            return false;
+        }
+        headerRead = true;
+        offset = PERF_DATA_PIPE_HEADER_SIZE;
+    }
+
+    while (true)
+    {
+        if (skipBytes > 0)
+        {
+            uint64_t skipped = min<uint64_t>(skipBytes, pending.size() - offset);
+            offset += skipped;
+            skipBytes -= skipped;
+            if (skipBytes > 0)
+            {
+                break;
+            }
+        }
+        struct perf_event_header header;
+        if (pending.size() - offset < sizeof(header))
+        {
+            break;
+        }
+        memcpy(&header, pending.data() + offset, sizeof(header));
+        if (header.size < sizeof(header))
+        {
+            fprintf(stderr, "ERROR: corrupt perf data record\n");
+            failed = true;
+            return false;
+        }
+        if (pending.size() - offset < header.size)
+        {
+            break;
+        }
+        skipBytes = handleRecord(pending.data() + offset, header.size);
+        offset += header.size;
+    }
+
+    /* keep the incomplete record at the start of pending, where it stays 8 byte aligned */
+    pending.erase(pending.begin(), pending.begin() + offset);
+    return true;
+}
+
+bool PerfDataReader::readFile(const char *fileName)
+{
+    perf_data_file_header_t header;
+    struct stat fileStat;
+    bool read = false;
+
+    int fd = open(fileName, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("ERROR opening perf data file");
+        return false;
+    }
+    if (fstat(fd, &fileStat) == -1 || (size_t)fileStat.st_size < PERF_DATA_PIPE_HEADER_SIZE)
+    {
+        fprintf(stderr, "ERROR: %s is not a perf data file\n", fileName);
+        close(fd);
+        return false;
+    }
+    size_t fileSize = (size_t)fileStat.st_size;
+    const uint8_t *base = (const uint8_t *)mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        perror("ERROR mapping perf data file");
+        return false;
+    }
+
+    memcpy(&header, base, PERF_DATA_PIPE_HEADER_SIZE);
+    if (header.magic == PERF_DATA_MAGIC && header.size == PERF_DATA_PIPE_HEADER_SIZE)
+    {
+        /* saved from "perf record -o -" */
+        read = feed(base, fileSize);
+    }
+    else if (header.magic == PERF_DATA_MAGIC && header.size == sizeof(header) && fileSize >= sizeof(header))
+    {
+        memcpy(&header, base, sizeof(header));
+        read = (header.attrSize > sizeof(perf_data_section_t) && header.attrs.offset + header.attrs.size <= fileSize);
+
+        /* each attribute is followed by the section holding the ids of its events */
+        for (uint64_t entry = 0; read && entry < header.attrs.size / header.attrSize; entry++)
+        {
+            const uint8_t *attr = base + header.attrs.offset + entry * header.attrSize;
+            size_t attrLength = header.attrSize - sizeof(perf_data_section_t);
+            perf_data_section_t ids;
+            memcpy(&ids, attr + attrLength, sizeof(ids));
+            if (ids.offset + ids.size > fileSize)
+            {
+                ids.size = 0;
+            }
+            addAttr(attr, attrLength, (const uint64_t *)(base + ids.offset), ids.size / sizeof(uint64_t));
+        }
+
+        /* perf only writes the data size when it exits cleanly */
+        uint64_t dataEnd = (header.data.size == 0) ? fileSize : header.data.offset + header.data.size;
+        uint64_t offset = header.data.offset;
+        dataEnd = min<uint64_t>(dataEnd, fileSize);
+        while (read && offset + sizeof(struct perf_event_header) <= dataEnd)
+        {
+            struct perf_event_header recordHeader;
+            memcpy(&recordHeader, base + offset, sizeof(recordHeader));
+            if (recordHeader.size < sizeof(recordHeader) || offset + recordHeader.size > dataEnd)
+            {
+                break;
+            }
+            offset += recordHeader.size + handleRecord(base + offset, recordHeader.size);
+        }
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: %s is not a perf data file in host byte order\n", fileName);
+    }
+
+    munmap((void *)base, fileSize);
+    return read;
+}
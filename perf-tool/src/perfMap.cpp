@@ -0,0 +1,266 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#include <atomic>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "agentOptions.hpp"
+#include "infra.hpp"
+#include "jitCodeIndex.hpp"
+#include "perfMap.hpp"
+#include "scheduler.hpp"
+
+using namespace std;
+
+struct perf_map_entry_t
+{
+    uint64_t length;
+    string symbol;
+};
+
+static atomic<bool> perfMapEnabled {false};
+static mutex perfMapMutex;
+static int perfMapFd = -1;
+static string perfMapPath;
+static string perfMapBuffer;
+/* code that is loaded now, by start address, to rewrite the file without unloaded code */
+static map<uint64_t, perf_map_entry_t> perfMapEntries;
+static size_t perfMapStaleEntries = 0;
+
+static void appendPerfMapLine(string& buffer, uint64_t address, uint64_t length, const string& symbol)
+{
+    char prefix[48];
+
+    snprintf(prefix, sizeof(prefix), "%llx %llx ", (unsigned long long)address, (unsigned long long)length);
+    buffer += prefix;
+    buffer += symbol;
+    buffer += '\n';
+}
+
+static bool writeAll(int fd, const string& data)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("ERROR writing perf map");
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+/* Must be called with perfMapMutex held */
+static void flushPerfMap(void)
+{
+    if (perfMapFd != -1 && !perfMapBuffer.empty())
+    {
+        writeAll(perfMapFd, perfMapBuffer);
+    }
+    perfMapBuffer.clear();
+}
+
+/* Must be called with perfMapMutex held. perf reads the map in order and cannot forget a
+ * range, so once most entries are stale the live ones are written to a new file that
+ * replaces the old one atomically. */
+static void compactPerfMap(void)
+{
+    string tempPath = perfMapPath + ".tmp";
+    string contents;
+
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        perror("ERROR opening perf map");
+        return;
+    }
+    for (auto& entry : perfMapEntries)
+    {
+        appendPerfMapLine(contents, entry.first, entry.second.length, entry.second.symbol);
+    }
+    if (!writeAll(fd, contents) || rename(tempPath.c_str(), perfMapPath.c_str()) == -1)
+    {
+        close(fd);
+        unlink(tempPath.c_str());
+        return;
+    }
+    close(perfMapFd);
+    perfMapFd = fd;
+    perfMapBuffer.clear();
+    perfMapStaleEntries = 0;
+}
+
+static void addPerfMapEntry(const void *address, jint length, const string& symbol)
+{
+    lock_guard<mutex> lock(perfMapMutex);
+    if (perfMapFd == -1)
+    {
+        return;
+    }
+    perfMapEntries[(uint64_t)address] = {(uint64_t)length, symbol};
+    appendPerfMapLine(perfMapBuffer, (uint64_t)address, (uint64_t)length, symbol);
+    if (perfMapBuffer.size() >= PERF_MAP_BUFFER_SIZE)
+    {
+        flushPerfMap();
+    }
+}
+
+bool getJavaMethodSymbol(jvmtiEnv *jvmtiEnv, jmethodID method, string& symbol)
+{
+    jvmtiError err;
+    jclass declaringClass;
+    char *className = NULL, *methodName = NULL, *methodSignature = NULL;
+
+    err = jvmtiEnv->GetMethodName(method, &methodName, &methodSignature, NULL);
+    if (!check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Method Name.\n"))
+    {
+        return false;
+    }
+    symbol.clear();
+    err = jvmtiEnv->GetMethodDeclaringClass(method, &declaringClass);
+    if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Method Declaring Class.\n"))
+    {
+        err = jvmtiEnv->GetClassSignature(declaringClass, &className, NULL);
+        if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Method Declaring Class Signature.\n"))
+        {
+            /* Ljava/lang/String; is written java.lang.String */
+            size_t length = strlen(className);
+            if (length >= 2 && className[0] == 'L' && className[length - 1] == ';')
+            {
+                symbol.assign(className + 1, length - 2);
+            }
+            else
+            {
+                symbol.assign(className);
+            }
+            for (char& c : symbol)
+            {
+                c = (c == '/') ? '.' : c;
+            }
+            symbol += '.';
+            jvmtiEnv->Deallocate((unsigned char *)className);
+        }
+    }
+    symbol += methodName;
+    symbol += methodSignature;
+    jvmtiEnv->Deallocate((unsigned char *)methodName);
+    jvmtiEnv->Deallocate((unsigned char *)methodSignature);
+    return true;
+}
+
+JNIEXPORT void JNICALL CompiledMethodLoad(jvmtiEnv *jvmtiEnv, jmethodID method, jint codeSize, const void *codeAddress,
+                                          jint mapLength, const jvmtiAddrLocationMap *map, const void *compileInfo)
+{
+    string symbol;
+
+    if (getJavaMethodSymbol(jvmtiEnv, method, symbol))
+    {
+        addJitCode(jvmtiEnv, method, codeAddress, codeSize, symbol, compileInfo);
+        if (perfMapEnabled)
+        {
+            addPerfMapEntry(codeAddress, codeSize, symbol);
+        }
+    }
+}
+
+JNIEXPORT void JNICALL CompiledMethodUnload(jvmtiEnv *jvmtiEnv, jmethodID method, const void *codeAddress)
+{
+    removeJitCode(codeAddress);
+    if (!perfMapEnabled)
+    {
+        return;
+    }
+
+    lock_guard<mutex> lock(perfMapMutex);
+    if (perfMapEntries.erase((uint64_t)codeAddress) > 0)
+    {
+        perfMapStaleEntries++;
+        if (perfMapStaleEntries >= PERF_MAP_MIN_STALE_ENTRIES && perfMapStaleEntries > perfMapEntries.size())
+        {
+            compactPerfMap();
+        }
+    }
+}
+
+JNIEXPORT void JNICALL DynamicCodeGenerated(jvmtiEnv *jvmtiEnv, const char *name, const void *address, jint length)
+{
+    addJitStub(address, length, name);
+    if (perfMapEnabled)
+    {
+        addPerfMapEntry(address, length, name);
+    }
+}
+
+void setPerfMap(bool enabled)
+{
+    jvmtiError error;
+
+    if (enabled && !perfMapEnabled)
+    {
+        {
+            lock_guard<mutex> lock(perfMapMutex);
+            perfMapPath = "/tmp/perf-" + to_string(getpid()) + ".map";
+            perfMapFd = open(perfMapPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+            if (perfMapFd == -1)
+            {
+                perror("ERROR opening perf map");
+                return;
+            }
+            perfMapEntries.clear();
+            perfMapStaleEntries = 0;
+        }
+        perfMapEnabled = true;
+
+        /* replay the code loaded before the map was started */
+        error = jvmti->GenerateEvents(JVMTI_EVENT_DYNAMIC_CODE_GENERATED);
+        check_jvmti_error(jvmti, error, "Unable to generate DynamicCodeGenerated events.");
+        error = jvmti->GenerateEvents(JVMTI_EVENT_COMPILED_METHOD_LOAD);
+        check_jvmti_error(jvmti, error, "Unable to generate CompiledMethodLoad events.");
+
+        schedulePeriodicTask("perfMap", PERF_MAP_FLUSH_SECONDS, [](jvmtiEnv *jvmti_env, JNIEnv *jni_env) {
+            lock_guard<mutex> lock(perfMapMutex);
+            flushPerfMap();
+        });
+    }
+    else if (!enabled && perfMapEnabled)
+    {
+        perfMapEnabled = false;
+        cancelPeriodicTask("perfMap");
+
+        lock_guard<mutex> lock(perfMapMutex);
+        flushPerfMap();
+        close(perfMapFd);
+        perfMapFd = -1;
+        perfMapEntries.clear();
+    }
+}
@@ -0,0 +1,218 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#include <algorithm>
+#include <linux/perf_event.h>
+#include <unistd.h>
+
+#include "infra.hpp"
+#include "perfProfile.hpp"
+#include "threads.hpp"
+
+using namespace std;
+
+static const char unknownFrame[] = "[unknown]";
+
+PerfProfile::PerfProfile(const perf_output_options_t& _options) : options(_options)
+{
+    nextProfile = chrono::steady_clock::now() + chrono::seconds(options.interval);
+    selfPid = getpid();
+}
+
+const pair<const char *, const char *>& PerfProfile::getThreadLabel(const perf_sample_t& sample)
+{
+    auto label = threadLabels.find(sample.tid);
+    if (label != threadLabels.end())
+    {
+        return label->second;
+    }
+
+    /* threads that are not Java threads, or not in this process, keep their command name */
+    java_thread_info_t thread;
+    pair<const char *, const char *> newLabel(symbolizer.getComm(sample.tid), (const char *)NULL);
+    if ((pid_t)sample.pid == selfPid && lookupJavaThread((pid_t)sample.tid, thread))
+    {
+        newLabel = make_pair(symbolizer.intern(thread.name.c_str()), symbolizer.intern(thread.group.c_str()));
+    }
+    return threadLabels[sample.tid] = newLabel;
+}
+
+void PerfProfile::addSample(const perf_sample_t& sample)
+{
+    if (options.sendSamples)
+    {
+        sendPerfSample(sample, sentSamples++, symbolizer, options);
+        return;
+    }
+
+    event_profile_t& profile = events[sample.event];
+    perf_symbol_t symbol = symbolizer.resolve(sample.pid, sample.ip);
+    counts_t& symbolCounts = profile.symbols[make_pair(symbol.symbol, symbol.dso)];
+    counts_t& dsoCounts = profile.dsos[symbol.dso];
+    counts_t& threadCounts = profile.threads[getThreadLabel(sample)];
+    symbolCounts.samples++;
+    symbolCounts.period += sample.period;
+    dsoCounts.samples++;
+    dsoCounts.period += sample.period;
+    threadCounts.samples++;
+    threadCounts.period += sample.period;
+    profile.total.samples++;
+    profile.total.period += sample.period;
+
+    if (sample.callchainLength > 0)
+    {
+        /* call chains are innermost first, with PERF_CONTEXT markers between kernel and user frames */
+        stack.clear();
+        for (uint64_t frame = sample.callchainLength; frame-- > 0;)
+        {
+            uint64_t ip = sample.callchain[frame];
+            if (ip >= PERF_CONTEXT_MAX)
+            {
+                continue;
+            }
+            perf_symbol_t resolved = symbolizer.resolve(sample.pid, ip);
+            stack.push_back(resolved.symbol != NULL ? resolved.symbol : (resolved.dso != NULL ? resolved.dso : unknownFrame));
+        }
+        counts_t& stackCounts = profile.stacks[stack];
+        stackCounts.samples++;
+        stackCounts.period += sample.period;
+    }
+}
+
+void PerfProfile::sendProfile(const char *event, event_profile_t& profile)
+{
+    unordered_map<const char *, size_t> stringIds;
+    json strings = json::array();
+    json jSymbols = json::array();
+    json jDsos = json::array();
+    json jThreads = json::array();
+    json jStacks = json::array();
+    json j;
+
+    if (profile.total.samples == 0)
+    {
+        return;
+    }
+
+    /* unknown names are null instead of an index in strings */
+    auto stringId = [&stringIds, &strings](const char *name) -> json {
+        if (name == NULL)
+        {
+            return nullptr;
+        }
+        auto id = stringIds.find(name);
+        if (id != stringIds.end())
+        {
+            return id->second;
+        }
+        stringIds[name] = strings.size();
+        strings.push_back(name);
+        return strings.size() - 1;
+    };
+    auto bySamples = [](const auto& a, const auto& b) { return a->second.samples > b->second.samples; };
+
+    vector<decltype(profile.symbols)::const_iterator> sortedSymbols;
+    for (auto entry = profile.symbols.cbegin(); entry != profile.symbols.cend(); entry++)
+    {
+        sortedSymbols.push_back(entry);
+    }
+    sort(sortedSymbols.begin(), sortedSymbols.end(), bySamples);
+    for (auto entry : sortedSymbols)
+    {
+        jSymbols.push_back({stringId(entry->first.first), stringId(entry->first.second), entry->second.samples, entry->second.period});
+    }
+
+    vector<decltype(profile.dsos)::const_iterator> sortedDsos;
+    for (auto entry = profile.dsos.cbegin(); entry != profile.dsos.cend(); entry++)
+    {
+        sortedDsos.push_back(entry);
+    }
+    sort(sortedDsos.begin(), sortedDsos.end(), bySamples);
+    for (auto entry : sortedDsos)
+    {
+        jDsos.push_back({stringId(entry->first), entry->second.samples, entry->second.period});
+    }
+
+    vector<decltype(profile.threads)::const_iterator> sortedThreads;
+    for (auto entry = profile.threads.cbegin(); entry != profile.threads.cend(); entry++)
+    {
+        sortedThreads.push_back(entry);
+    }
+    sort(sortedThreads.begin(), sortedThreads.end(), bySamples);
+    for (auto entry : sortedThreads)
+    {
+        jThreads.push_back({stringId(entry->first.first), stringId(entry->first.second), entry->second.samples, entry->second.period});
+    }
+
+    for (const auto& entry : profile.stacks)
+    {
+        json frames = json::array();
+        for (const char *frame : entry.first)
+        {
+            frames.push_back(stringId(frame));
+        }
+        jStacks.push_back({frames, entry.second.samples, entry.second.period});
+    }
+
+    j["perfProfile"]["session"] = options.session;
+    j["perfProfile"]["event"] = (event != NULL) ? event : unknownFrame;
+    j["perfProfile"]["samples"] = profile.total.samples;
+    j["perfProfile"]["period"] = profile.total.period;
+    j["perfProfile"]["strings"] = strings;
+    j["perfProfile"]["symbols"] = jSymbols;
+    j["perfProfile"]["dsos"] = jDsos;
+    j["perfProfile"]["threads"] = jThreads;
+    if (options.callGraph)
+    {
+        j["perfProfile"]["stacks"] = jStacks;
+    }
+    sendToServer(j.dump());
+}
+
+void PerfProfile::sendProfiles(void)
+{
+    for (auto& event : events)
+    {
+        sendProfile(event.first, event.second);
+    }
+    events.clear();
+    threadLabels.clear();
+}
+
+void PerfProfile::poll(void)
+{
+    if (options.interval > 0 && chrono::steady_clock::now() >= nextProfile)
+    {
+        sendProfiles();
+        nextProfile = chrono::steady_clock::now() + chrono::seconds(options.interval);
+    }
+}
+
+void PerfProfile::finish(uint64_t samples, uint64_t lost)
+{
+    json perfSummary;
+
+    sendProfiles();
+    perfSummary["perfSummary"]["session"] = options.session;
+    perfSummary["perfSummary"]["samples"] = samples;
+    perfSummary["perfSummary"]["lost"] = lost;
+    sendToServer(perfSummary.dump());
+}
@@ -0,0 +1,412 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <errno.h>
+#include <memory>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "infra.hpp"
+#include "json.hpp"
+#include "perfProfile.hpp"
+#include "perfSampler.hpp"
+#include "perfSession.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+static mutex perfSamplersMutex;
+static vector<PerfSampler *> perfSamplers;
+
+PerfSampler::PerfSampler(const perf_sampler_config_t& _config, function<void(const perf_sample_t&)> _onSample)
+    : config(_config), onSample(_onSample)
+{
+    pageSize = (size_t)sysconf(_SC_PAGESIZE);
+}
+
+PerfSampler::~PerfSampler()
+{
+    stop();
+}
+
+bool PerfSampler::addThread(pid_t tid)
+{
+    struct perf_event_attr attr;
+    size_t ringSize = PERF_SAMPLER_RING_PAGES * pageSize;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = config.type;
+    attr.config = config.config;
+    attr.freq = 1;
+    attr.sample_freq = config.frequency;
+    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CPU | PERF_SAMPLE_PERIOD;
+    if (config.callGraph)
+    {
+        attr.sample_type |= PERF_SAMPLE_CALLCHAIN;
+    }
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.watermark = 1;
+    attr.wakeup_watermark = (uint32_t)(ringSize / 4);
+
+    int fd = perfEventOpen(&attr, tid, -1);
+    if (fd < 0)
+    {
+        return false;
+    }
+    void *base = mmap(NULL, ringSize + pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+    unique_ptr<ring_t> ring(new ring_t);
+    ring->tid = tid;
+    ring->fd = fd;
+    ring->base = base;
+    ring->ended = false;
+
+    lock_guard<mutex> lock(ringsMutex);
+    rings.push_back(move(ring));
+    return true;
+}
+
+void PerfSampler::removeThread(pid_t tid)
+{
+    /* samples are only decoded on the session's thread, so the ring is left for poll to drain */
+    lock_guard<mutex> lock(ringsMutex);
+    for (unique_ptr<ring_t>& ring : rings)
+    {
+        if (ring->tid == tid && !ring->ended.load(memory_order_relaxed))
+        {
+            ioctl(ring->fd, PERF_EVENT_IOC_DISABLE, 0);
+            ring->ended.store(true, memory_order_release);
+        }
+    }
+}
+
+bool PerfSampler::start(void)
+{
+    DIR *tasks = opendir("/proc/self/task");
+    struct dirent *task;
+    bool opened = false;
+
+    if (tasks == NULL)
+    {
+        perror("ERROR opening /proc/self/task");
+        return false;
+    }
+    while ((task = readdir(tasks)) != NULL)
+    {
+        if (task->d_name[0] != '.')
+        {
+            opened |= addThread((pid_t)atoi(task->d_name));
+        }
+    }
+    closedir(tasks);
+
+    if (opened)
+    {
+        lock_guard<mutex> lock(perfSamplersMutex);
+        perfSamplers.push_back(this);
+    }
+    return opened;
+}
+
+void PerfSampler::decodeSample(const uint8_t *record, size_t size)
+{
+    /* field order is fixed by perf_event.h for the sample_type set in addThread */
+    const uint8_t *p = record + sizeof(struct perf_event_header);
+    const uint8_t *end = record + size;
+    perf_sample_t sample;
+    uint32_t cpuAndReserved[2];
+
+    if (p + 5 * sizeof(uint64_t) > end)
+    {
+        return;
+    }
+    sample.event = config.name;
+    memcpy(&sample.ip, p, sizeof(uint64_t));
+    p += sizeof(uint64_t);
+    memcpy(&sample.pid, p, sizeof(uint32_t));
+    memcpy(&sample.tid, p + sizeof(uint32_t), sizeof(uint32_t));
+    p += sizeof(uint64_t);
+    memcpy(&sample.time, p, sizeof(uint64_t));
+    p += sizeof(uint64_t);
+    memcpy(cpuAndReserved, p, sizeof(cpuAndReserved));
+    sample.cpu = cpuAndReserved[0];
+    p += sizeof(uint64_t);
+    memcpy(&sample.period, p, sizeof(uint64_t));
+    p += sizeof(uint64_t);
+
+    sample.callchainLength = 0;
+    sample.callchain = NULL;
+    if (config.callGraph && p + sizeof(uint64_t) <= end)
+    {
+        uint64_t length;
+        memcpy(&length, p, sizeof(uint64_t));
+        p += sizeof(uint64_t);
+        if (p + length * sizeof(uint64_t) <= end)
+        {
+            /* records are 8 byte aligned in the ring and in wrapBuffer */
+            sample.callchainLength = length;
+            sample.callchain = (const uint64_t *)p;
+        }
+    }
+
+    samples++;
+    onSample(sample);
+}
+
+void PerfSampler::drain(ring_t& ring)
+{
+    struct perf_event_mmap_page *header = (struct perf_event_mmap_page *)ring.base;
+    uint8_t *data = (uint8_t *)ring.base + pageSize;
+    uint64_t dataSize = PERF_SAMPLER_RING_PAGES * pageSize;
+    uint64_t head = __atomic_load_n(&header->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = header->data_tail;
+
+    while (tail + sizeof(struct perf_event_header) <= head)
+    {
+        struct perf_event_header recordHeader;
+        uint64_t offset = tail % dataSize;
+        const uint8_t *record = data + offset;
+
+        if (offset + sizeof(recordHeader) <= dataSize)
+        {
+            memcpy(&recordHeader, record, sizeof(recordHeader));
+        }
+        else
+        {
+            size_t first = (size_t)(dataSize - offset);
+            memcpy(&recordHeader, record, first);
+            memcpy((uint8_t *)&recordHeader + first, data, sizeof(recordHeader) - first);
+        }
+        if (recordHeader.size == 0 || tail + recordHeader.size > head)
+        {
+            break;
+        }
+        if (offset + recordHeader.size > dataSize)
+        {
+            /* the record wraps around the end of the ring, copy it out in one piece */
+            size_t first = (size_t)(dataSize - offset);
+            wrapBuffer.resize(recordHeader.size);
+            memcpy(wrapBuffer.data(), record, first);
+            memcpy(wrapBuffer.data() + first, data, recordHeader.size - first);
+            record = wrapBuffer.data();
+        }
+
+        if (recordHeader.type == PERF_RECORD_SAMPLE)
+        {
+            decodeSample(record, recordHeader.size);
+        }
+        else if (recordHeader.type == PERF_RECORD_LOST && recordHeader.size >= sizeof(recordHeader) + 2 * sizeof(uint64_t))
+        {
+            uint64_t lost;
+            memcpy(&lost, record + sizeof(recordHeader) + sizeof(uint64_t), sizeof(lost));
+            lostSamples += lost;
+        }
+        tail += recordHeader.size;
+    }
+
+    __atomic_store_n(&header->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+void PerfSampler::poll(int timeoutMillis)
+{
+    /* only this thread removes rings, so they stay valid after the lock is released */
+    vector<ring_t *> polled;
+    vector<struct pollfd> fds;
+    {
+        lock_guard<mutex> lock(ringsMutex);
+        for (unique_ptr<ring_t>& ring : rings)
+        {
+            polled.push_back(ring.get());
+            fds.push_back({ring->fd, POLLIN, 0});
+        }
+    }
+    if (::poll(fds.data(), fds.size(), timeoutMillis) < 0 && errno != EINTR)
+    {
+        return;
+    }
+
+    /* the event of an exited thread reports POLLHUP from then on, which would make every
+     * poll return at once. A ring that ended before it is drained has nothing more coming. */
+    vector<ring_t *> finished;
+    for (size_t i = 0; i < polled.size(); i++)
+    {
+        bool ended = polled[i]->ended.load(memory_order_acquire) || (fds[i].revents & (POLLHUP | POLLERR)) != 0;
+        drain(*polled[i]);
+        if (ended)
+        {
+            finished.push_back(polled[i]);
+        }
+    }
+    if (finished.empty())
+    {
+        return;
+    }
+
+    vector<unique_ptr<ring_t>> closed;
+    {
+        lock_guard<mutex> lock(ringsMutex);
+        size_t kept = 0;
+        for (size_t i = 0; i < rings.size(); i++)
+        {
+            if (find(finished.begin(), finished.end(), rings[i].get()) != finished.end())
+            {
+                closed.push_back(move(rings[i]));
+            }
+            else
+            {
+                rings[kept++] = move(rings[i]);
+            }
+        }
+        rings.resize(kept);
+    }
+    for (unique_ptr<ring_t>& ring : closed)
+    {
+        closeRing(*ring);
+    }
+}
+
+void PerfSampler::closeRing(ring_t& ring)
+{
+    munmap(ring.base, (PERF_SAMPLER_RING_PAGES + 1) * pageSize);
+    close(ring.fd);
+}
+
+void PerfSampler::stop(void)
+{
+    {
+        lock_guard<mutex> lock(perfSamplersMutex);
+        for (size_t i = 0; i < perfSamplers.size(); i++)
+        {
+            if (perfSamplers[i] == this)
+            {
+                perfSamplers.erase(perfSamplers.begin() + i);
+                break;
+            }
+        }
+    }
+
+    vector<unique_ptr<ring_t>> closed;
+    {
+        lock_guard<mutex> lock(ringsMutex);
+        closed.swap(rings);
+    }
+    for (unique_ptr<ring_t>& ring : closed)
+    {
+        ioctl(ring->fd, PERF_EVENT_IOC_DISABLE, 0);
+        drain(*ring);
+        closeRing(*ring);
+    }
+}
+
+void addThreadToPerfSamplers(void)
+{
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+
+    lock_guard<mutex> lock(perfSamplersMutex);
+    for (PerfSampler *sampler : perfSamplers)
+    {
+        sampler->addThread(tid);
+    }
+}
+
+void removeThreadFromPerfSamplers(void)
+{
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+
+    lock_guard<mutex> lock(perfSamplersMutex);
+    for (PerfSampler *sampler : perfSamplers)
+    {
+        sampler->removeThread(tid);
+    }
+}
+
+void perfSampleProcess(const perf_session_config_t& session, const atomic<bool>& cancelled)
+{
+    PerfProfile profile(session.output);
+    auto onSample = [&profile](const perf_sample_t& sample) { profile.addSample(sample); };
+    vector<unique_ptr<PerfSampler>> samplers;
+    uint64_t samples = 0, lost = 0;
+
+    for (const string& name : session.events)
+    {
+        const perf_event_type_t *event = findPerfEvent(name);
+        perf_sampler_config_t config = {event->name, event->type, event->config, session.frequency, session.output.callGraph};
+        unique_ptr<PerfSampler> sampler(new PerfSampler(config, onSample));
+        bool started = sampler->start();
+
+        if (!started && event->type == PERF_TYPE_HARDWARE && event->config == PERF_COUNT_HW_CPU_CYCLES)
+        {
+            /* virtual machines and containers often have no hardware counters, fall back to a timer */
+            event = findPerfEvent("cpu-clock");
+            config = {event->name, event->type, event->config, session.frequency, session.output.callGraph};
+            sampler.reset(new PerfSampler(config, onSample));
+            started = sampler->start();
+        }
+        if (!started)
+        {
+            fprintf(stderr, "ERROR: perf_event_open failed for %s, check /proc/sys/kernel/perf_event_paranoid\n", name.c_str());
+            continue;
+        }
+        samplers.push_back(move(sampler));
+    }
+    if (samplers.empty())
+    {
+        return;
+    }
+
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(session.recordTime);
+    while (!cancelled && (session.recordTime == 0 || chrono::steady_clock::now() < deadline))
+    {
+        /* wait on the first sampler only, then pick up whatever the others have */
+        for (size_t i = 0; i < samplers.size(); i++)
+        {
+            samplers[i]->poll((i == 0) ? PERF_SAMPLER_POLL_MILLIS : 0);
+        }
+        profile.poll();
+    }
+    for (unique_ptr<PerfSampler>& sampler : samplers)
+    {
+        sampler->stop();
+        samples += sampler->getSampleCount();
+        lost += sampler->getLostCount();
+    }
+    profile.finish(samples, lost);
+}
@@ -0,0 +1,328 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+#include <stdio.h>
+#include <unistd.h>
+
+#include "infra.hpp"
+#include "perf.hpp"
+#include "perfSampler.hpp"
+#include "perfSession.hpp"
+
+using namespace std;
+
+static perfOption_t findPerfOption(const string& key)
+{
+    for (int option = PERF_OPTION_UNKNOWN + 1; option < PERF_OPTION_MAX; option++)
+    {
+        if (!key.compare(perfOptionNames[option]))
+        {
+            return (perfOption_t)option;
+        }
+    }
+    return PERF_OPTION_UNKNOWN;
+}
+
+static perfField_t findPerfField(const string& name)
+{
+    for (int field = PERF_FIELD_UNKNOWN + 1; field < PERF_FIELD_MAX; field++)
+    {
+        if (!name.compare(perfFieldNames[field]))
+        {
+            return (perfField_t)field;
+        }
+    }
+    return PERF_FIELD_UNKNOWN;
+}
+
+/* Integer options may be sent as strings, as the original perf command's "time" was */
+static int getIntOption(const json& value)
+{
+    return value.is_string() ? stoi(value.get<string>()) : value.get<int>();
+}
+
+bool parsePerfSessionConfig(const json& command, perf_session_config_t& config)
+{
+    config.name = PERF_SESSION_DEFAULT_NAME;
+    config.pid = getpid();
+    config.recordTime = 0;
+    config.events = {"cycles"};
+    config.frequency = PERF_SESSION_DEFAULT_FREQUENCY;
+    config.external = false;
+    config.file.clear();
+    config.output.interval = 0;
+    config.output.callGraph = false;
+    config.output.sendSamples = false;
+    config.output.fields = PERF_FIELDS_ALL;
+
+    /* options come from clients; a value of the wrong type or a number that does not parse
+     * must fail the command, not throw out of the server */
+    string key;
+    try
+    {
+        for (auto& option : command.items())
+        {
+            const json& value = option.value();
+            key = option.key();
+
+            switch (findPerfOption(key))
+            {
+            case PERF_OPTION_PID:
+                config.pid = (pid_t)getIntOption(value);
+                break;
+            case PERF_OPTION_REC_TIME:
+                config.recordTime = getIntOption(value);
+                break;
+            case PERF_OPTION_FIELDS:
+                config.output.fields = 0;
+                for (const json& name : value)
+                {
+                    perfField_t field = findPerfField(name.get<string>());
+                    if (field == PERF_FIELD_UNKNOWN)
+                    {
+                        fprintf(stderr, "ERROR: unknown perf field %s\n", name.get<string>().c_str());
+                        return false;
+                    }
+                    config.output.fields |= 1u << field;
+                }
+                break;
+            case PERF_OPTION_SESSION:
+                config.name = value.get<string>();
+                break;
+            case PERF_OPTION_EVENTS:
+                config.events.clear();
+                for (const json& name : value)
+                {
+                    if (findPerfEvent(name.get<string>()) == NULL)
+                    {
+                        fprintf(stderr, "ERROR: unsupported perf event %s\n", name.get<string>().c_str());
+                        return false;
+                    }
+                    config.events.push_back(name.get<string>());
+                }
+                break;
+            case PERF_OPTION_FREQUENCY:
+            {
+                int frequency = getIntOption(value);
+                if (frequency <= 0)
+                {
+                    fprintf(stderr, "ERROR: perf frequency must be positive, got %d\n", frequency);
+                    return false;
+                }
+                config.frequency = (uint64_t)frequency;
+                break;
+            }
+            case PERF_OPTION_CALL_GRAPH:
+                config.output.callGraph = value.get<bool>();
+                break;
+            case PERF_OPTION_INTERVAL:
+                config.output.interval = getIntOption(value);
+                break;
+            case PERF_OPTION_OUTPUT:
+                config.output.sendSamples = !value.get<string>().compare("samples");
+                break;
+            case PERF_OPTION_BACKEND:
+                config.external = !value.get<string>().compare("external");
+                break;
+            case PERF_OPTION_FILE:
+                config.file = value.get<string>();
+                break;
+            default:
+                /* functionality, command, delay */
+                break;
+            }
+        }
+    }
+    catch (const json::exception& e)
+    {
+        fprintf(stderr, "ERROR: invalid perf option %s: %s\n", key.c_str(), e.what());
+        return false;
+    }
+    catch (const invalid_argument& e)
+    {
+        fprintf(stderr, "ERROR: perf option %s is not a number\n", key.c_str());
+        return false;
+    }
+    catch (const out_of_range& e)
+    {
+        fprintf(stderr, "ERROR: perf option %s is out of range\n", key.c_str());
+        return false;
+    }
+
+    if (config.events.empty() || config.frequency == 0 || config.recordTime < 0 || config.output.interval < 0)
+    {
+        fprintf(stderr, "ERROR: perf session %s needs events, a frequency and positive times\n", config.name.c_str());
+        return false;
+    }
+    config.output.session = config.name;
+    return true;
+}
+
+PerfSession::PerfSession(const perf_session_config_t& _config) : config(_config)
+{
+}
+
+PerfSession::~PerfSession()
+{
+    cancel();
+    join();
+}
+
+void PerfSession::start(void)
+{
+    startTime = chrono::steady_clock::now();
+    thread = std::thread(&PerfSession::run, this);
+}
+
+void PerfSession::join(void)
+{
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+void PerfSession::run(void)
+{
+    if (!config.file.empty())
+    {
+        perfDecodeFile(config);
+    }
+    else if (config.external)
+    {
+        perfProcess(config, cancelled);
+    }
+    else
+    {
+        perfSampleProcess(config, cancelled);
+    }
+    finished = true;
+}
+
+json PerfSession::getStatus(void) const
+{
+    json status;
+
+    status["session"] = config.name;
+    status["state"] = finished ? "finished" : (cancelled ? "stopping" : "running");
+    status["backend"] = !config.file.empty() ? "file" : (config.external ? "external" : "inProcess");
+    status["events"] = config.events;
+    status["frequency"] = config.frequency;
+    status["time"] = config.recordTime;
+    status["elapsed"] = chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - startTime).count();
+    return status;
+}
+
+void PerfSessionManager::startSession(const json& command)
+{
+    perf_session_config_t config;
+
+    if (!parsePerfSessionConfig(command, config))
+    {
+        return;
+    }
+
+    lock_guard<mutex> lock(sessionsMutex);
+    auto session = sessions.find(config.name);
+    if (session != sessions.end())
+    {
+        if (!session->second->isFinished())
+        {
+            fprintf(stderr, "ERROR: perf session %s is already running\n", config.name.c_str());
+            return;
+        }
+        /* only joins, the thread has already returned */
+        sessions.erase(session);
+    }
+    unique_ptr<PerfSession> newSession(new PerfSession(config));
+    newSession->start();
+    sessions[config.name] = move(newSession);
+}
+
+void PerfSessionManager::stopSession(const string& name)
+{
+    lock_guard<mutex> lock(sessionsMutex);
+    auto session = sessions.find(name);
+    if (session == sessions.end())
+    {
+        fprintf(stderr, "ERROR: no perf session %s\n", name.c_str());
+        return;
+    }
+    /* the backend sends its data and finishes on its own thread */
+    session->second->cancel();
+}
+
+void PerfSessionManager::sendStatus(void)
+{
+    json j;
+
+    j["perfSessions"] = json::array();
+    lock_guard<mutex> lock(sessionsMutex);
+    for (auto& session : sessions)
+    {
+        j["perfSessions"].push_back(session.second->getStatus());
+    }
+    sendToServer(j.dump());
+}
+
+void PerfSessionManager::handleCommand(const json& command)
+{
+    /* delayed commands run outside the server's try, so a value of the wrong type must not throw from here */
+    try
+    {
+        string action = command.value("command", string("start"));
+
+        if (!action.compare("start"))
+        {
+            startSession(command);
+        }
+        else if (!action.compare("stop"))
+        {
+            stopSession(command.value(perfOptionNames[PERF_OPTION_SESSION], string(PERF_SESSION_DEFAULT_NAME)));
+        }
+        else if (!action.compare("status"))
+        {
+            sendStatus();
+        }
+        else
+        {
+            fprintf(stderr, "ERROR: unknown perf command %s\n", action.c_str());
+        }
+    }
+    catch (const json::exception& e)
+    {
+        fprintf(stderr, "ERROR: invalid perf command: %s\n", e.what());
+    }
+}
+
+void PerfSessionManager::stopAll(void)
+{
+    lock_guard<mutex> lock(sessionsMutex);
+    for (auto& session : sessions)
+    {
+        session.second->cancel();
+    }
+    for (auto& session : sessions)
+    {
+        session.second->join();
+    }
+    sessions.clear();
+}
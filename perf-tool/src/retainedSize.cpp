@@ -0,0 +1,385 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <jvmti.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "agentOptions.hpp"
+#include "classTags.hpp"
+#include "heapWalk.hpp"
+#include "infra.hpp"
+#include "json.hpp"
+#include "retainedSize.hpp"
+#include "scheduler.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+#define HEAP_GRAPH_NONE UINT32_MAX
+#define HEAP_GRAPH_IS_CLASS 0x80
+
+/* Node 0 is a super root referring to every GC root. Objects are numbered in the order
+ * FollowReferences reaches them and their walk environment tag is their node number. */
+struct heap_graph_t
+{
+    vector<uint32_t> nodeClass;         /* class tag, or the class' own tag for class objects */
+    vector<uint64_t> nodeSize;
+    vector<uint8_t> nodeFlags;          /* root kind of GC roots, HEAP_GRAPH_IS_CLASS */
+    vector<uint32_t> classNodes;        /* node of each class object, by class tag */
+    vector<uint32_t> edgeFrom;
+    vector<uint32_t> edgeTo;
+    bool overflow;
+};
+
+/* Compressed sparse rows: the neighbours of node n are targets[offsets[n]] .. targets[offsets[n + 1]] */
+struct heap_csr_t
+{
+    vector<uint32_t> offsets;
+    vector<uint32_t> targets;
+};
+
+static uint32_t newHeapGraphNode(heap_graph_t *graph, jlong classTag, jlong size, uint8_t flags)
+{
+    if (graph->nodeClass.size() >= (size_t)HEAP_GRAPH_NONE - 1)
+    {
+        graph->overflow = true;
+        return 0;
+    }
+    graph->nodeClass.push_back((uint32_t)classTag);
+    graph->nodeSize.push_back((uint64_t)size);
+    graph->nodeFlags.push_back(flags);
+    return (uint32_t)(graph->nodeClass.size() - 1);
+}
+
+/* Node of a tagged object, or 0 if it has not been reached yet */
+static uint32_t heapGraphNode(heap_graph_t *graph, jlong tag)
+{
+    jlong classTag = heapWalkClassTag(tag);
+    if (classTag == 0)
+    {
+        return (uint32_t)tag;
+    }
+    return (classTag < (jlong)graph->classNodes.size()) ? graph->classNodes[classTag] : 0;
+}
+
+static jint JNICALL retainedSizeReferenceCallback(jvmtiHeapReferenceKind referenceKind,
+    const jvmtiHeapReferenceInfo *referenceInfo, jlong classTag, jlong referrerClassTag, jlong size,
+    jlong *tagPtr, jlong *referrerTagPtr, jint length, void *userData)
+{
+    heap_graph_t *graph = (heap_graph_t *)userData;
+    uint32_t node = heapGraphNode(graph, *tagPtr);
+
+    if (node == 0)
+    {
+        jlong ownClassTag = heapWalkClassTag(*tagPtr);
+        if (ownClassTag != 0 && ownClassTag < (jlong)graph->classNodes.size())
+        {
+            /* class objects keep their class tag and are found through classNodes */
+            node = newHeapGraphNode(graph, ownClassTag, size, HEAP_GRAPH_IS_CLASS);
+            graph->classNodes[ownClassTag] = node;
+        }
+        else
+        {
+            node = newHeapGraphNode(graph, heapWalkClassTag(classTag), size, 0);
+            *tagPtr = node;
+        }
+        if (node == 0)
+        {
+            return JVMTI_VISIT_ABORT;
+        }
+    }
+
+    uint32_t referrer = (referrerTagPtr == NULL) ? 0 : heapGraphNode(graph, *referrerTagPtr);
+    if (referrer == 0 && (graph->nodeFlags[node] & ~HEAP_GRAPH_IS_CLASS) == 0)
+    {
+        graph->nodeFlags[node] |= (uint8_t)referenceKind;
+    }
+    if (referrer != node)
+    {
+        graph->edgeFrom.push_back(referrer);
+        graph->edgeTo.push_back(node);
+    }
+
+    return JVMTI_VISIT_OBJECTS;
+}
+
+static void buildCSR(size_t nodeCount, const vector<uint32_t>& from, const vector<uint32_t>& to, heap_csr_t& csr)
+{
+    csr.offsets.assign(nodeCount + 1, 0);
+    csr.targets.resize(from.size());
+    for (uint32_t source : from)
+    {
+        csr.offsets[source + 1]++;
+    }
+    for (size_t i = 0; i < nodeCount; i++)
+    {
+        csr.offsets[i + 1] += csr.offsets[i];
+    }
+
+    /* offsets[n] is used as the fill cursor of n and restored afterwards */
+    for (size_t i = 0; i < from.size(); i++)
+    {
+        csr.targets[csr.offsets[from[i]]++] = to[i];
+    }
+    for (size_t i = nodeCount; i > 0; i--)
+    {
+        csr.offsets[i] = csr.offsets[i - 1];
+    }
+    csr.offsets[0] = 0;
+}
+
+/* Iterative Lengauer-Tarjan with path compression. Returns, for every node reachable from
+ * node 0, its immediate dominator in idom and the nodes in depth first order in vertex. */
+static void computeDominators(const heap_csr_t& successors, const heap_csr_t& predecessors,
+    vector<uint32_t>& vertex, vector<uint32_t>& idom)
+{
+    size_t nodeCount = successors.offsets.size() - 1;
+    vector<uint32_t> preorder(nodeCount, HEAP_GRAPH_NONE);
+    vector<uint32_t> parent, semi, ancestor, label, bucketHead, bucketNext, path;
+
+    /* depth first numbering, the explicit stack holds the next edge to visit of each node */
+    vector<uint32_t> stackNode, stackEdge;
+    vertex.clear();
+    stackNode.push_back(0);
+    stackEdge.push_back(successors.offsets[0]);
+    preorder[0] = 0;
+    vertex.push_back(0);
+    parent.push_back(HEAP_GRAPH_NONE);
+    while (!stackNode.empty())
+    {
+        uint32_t node = stackNode.back();
+        uint32_t& edge = stackEdge.back();
+        if (edge == successors.offsets[node + 1])
+        {
+            stackNode.pop_back();
+            stackEdge.pop_back();
+            continue;
+        }
+        uint32_t next = successors.targets[edge++];
+        if (preorder[next] == HEAP_GRAPH_NONE)
+        {
+            preorder[next] = (uint32_t)vertex.size();
+            vertex.push_back(next);
+            parent.push_back(preorder[node]);
+            stackNode.push_back(next);
+            stackEdge.push_back(successors.offsets[next]);
+        }
+    }
+
+    /* from here on nodes are identified by their preorder number */
+    size_t count = vertex.size();
+    semi.resize(count);
+    label.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        semi[i] = label[i] = (uint32_t)i;
+    }
+    ancestor.assign(count, HEAP_GRAPH_NONE);
+    bucketHead.assign(count, HEAP_GRAPH_NONE);
+    bucketNext.assign(count, HEAP_GRAPH_NONE);
+    idom.assign(count, 0);
+
+    auto eval = [&](uint32_t v) -> uint32_t {
+        if (ancestor[v] == HEAP_GRAPH_NONE)
+        {
+            return v;
+        }
+        path.clear();
+        for (uint32_t u = v; ancestor[ancestor[u]] != HEAP_GRAPH_NONE; u = ancestor[u])
+        {
+            path.push_back(u);
+        }
+        while (!path.empty())
+        {
+            uint32_t x = path.back();
+            uint32_t a = ancestor[x];
+            path.pop_back();
+            if (semi[label[a]] < semi[label[x]])
+            {
+                label[x] = label[a];
+            }
+            ancestor[x] = ancestor[a];
+        }
+        return label[v];
+    };
+
+    for (size_t w = count - 1; w > 0; w--)
+    {
+        uint32_t node = vertex[w];
+        for (uint32_t e = predecessors.offsets[node]; e < predecessors.offsets[node + 1]; e++)
+        {
+            uint32_t v = preorder[predecessors.targets[e]];
+            if (v == HEAP_GRAPH_NONE)
+            {
+                continue;
+            }
+            uint32_t u = eval(v);
+            if (semi[u] < semi[w])
+            {
+                semi[w] = semi[u];
+            }
+        }
+        bucketNext[w] = bucketHead[semi[w]];
+        bucketHead[semi[w]] = (uint32_t)w;
+        ancestor[w] = parent[w];
+
+        uint32_t p = parent[w];
+        for (uint32_t v = bucketHead[p]; v != HEAP_GRAPH_NONE; v = bucketNext[v])
+        {
+            uint32_t u = eval(v);
+            idom[v] = (semi[u] < semi[v]) ? u : p;
+        }
+        bucketHead[p] = HEAP_GRAPH_NONE;
+    }
+    for (size_t w = 1; w < count; w++)
+    {
+        if (idom[w] != semi[w])
+        {
+            idom[w] = idom[idom[w]];
+        }
+    }
+}
+
+static string heapGraphNodeName(const heap_graph_t& graph, uint32_t node)
+{
+    return getClassTagName(graph.nodeClass[node]);
+}
+
+static void sendRetainedSize(const heap_graph_t& graph, int topN, double walkMs)
+{
+    heap_csr_t successors, predecessors;
+    vector<uint32_t> vertex, idom;
+    size_t nodeCount = graph.nodeClass.size();
+    size_t edgeCount = graph.edgeFrom.size();
+
+    auto start = chrono::steady_clock::now();
+    buildCSR(nodeCount, graph.edgeFrom, graph.edgeTo, successors);
+    buildCSR(nodeCount, graph.edgeTo, graph.edgeFrom, predecessors);
+    computeDominators(successors, predecessors, vertex, idom);
+
+    /* children come after their dominator in preorder, so one backwards pass sums subtrees */
+    size_t count = vertex.size();
+    vector<uint64_t> retained(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        retained[i] = graph.nodeSize[vertex[i]];
+    }
+    for (size_t i = count - 1; i > 0; i--)
+    {
+        retained[idom[i]] += retained[i];
+    }
+
+    vector<uint32_t> top;
+    for (uint32_t i = 1; i < count; i++)
+    {
+        top.push_back(i);
+    }
+    size_t reported = min(top.size(), (size_t)max(topN, 0));
+    partial_sort(top.begin(), top.begin() + reported, top.end(), [&retained](uint32_t a, uint32_t b) {
+        return retained[a] > retained[b];
+    });
+    double analysisMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    json jRetained;
+    jRetained["walkMs"] = walkMs;
+    jRetained["analysisMs"] = analysisMs;
+    jRetained["objects"] = count - 1;
+    jRetained["references"] = edgeCount;
+    jRetained["totalBytes"] = retained[0];
+    jRetained["truncated"] = graph.overflow;
+    jRetained["dominators"] = json::array();
+    for (size_t i = 0; i < reported; i++)
+    {
+        uint32_t node = vertex[top[i]];
+        json jDominator;
+        jDominator["className"] = heapGraphNodeName(graph, node);
+        jDominator["isClass"] = (graph.nodeFlags[node] & HEAP_GRAPH_IS_CLASS) != 0;
+        jDominator["shallowBytes"] = graph.nodeSize[node];
+        jDominator["retainedBytes"] = retained[top[i]];
+        jDominator["retainedPercent"] = retained[0] > 0 ? 100.0 * retained[top[i]] / retained[0] : 0.0;
+
+        /* dominators from the object up to the one held directly by a GC root */
+        json jPath = json::array();
+        uint32_t v = top[i];
+        int depth = 0;
+        while (idom[v] != 0)
+        {
+            v = idom[v];
+            if (depth++ < RETAINED_SIZE_PATH_DEPTH)
+            {
+                jPath.push_back(heapGraphNodeName(graph, vertex[v]));
+            }
+        }
+        uint8_t rootKind = graph.nodeFlags[vertex[v]] & ~HEAP_GRAPH_IS_CLASS;
+        jDominator["dominatorPath"] = jPath;
+        jDominator["dominatorDepth"] = depth;
+        jDominator["rootClassName"] = heapGraphNodeName(graph, vertex[v]);
+        jDominator["rootKind"] = rootKind != 0 ? heapReferenceKindName((jvmtiHeapReferenceKind)rootKind) : "multiple";
+        jRetained["dominators"].push_back(jDominator);
+    }
+
+    json j;
+    j["retainedSize"] = jRetained;
+    sendToServer(j.dump());
+}
+
+void requestRetainedSize(int topN)
+{
+    submitTask([topN](jvmtiEnv *jvmti_env, JNIEnv *jni_env) {
+        heap_graph_t graph;
+        jvmtiHeapCallbacks callbacks;
+        jvmtiError err;
+
+        jvmtiEnv *walkEnv = createHeapWalkEnv();
+        if (walkEnv == NULL)
+        {
+            return;
+        }
+
+        auto start = chrono::steady_clock::now();
+        graph.overflow = false;
+        if (tagClassesForHeapWalk(walkEnv, jvmti_env, jni_env))
+        {
+            graph.classNodes.assign((size_t)getClassTagCount() + 1, 0);
+            newHeapGraphNode(&graph, 0, 0, 0);
+
+            memset(&callbacks, 0, sizeof(callbacks));
+            callbacks.heap_reference_callback = &retainedSizeReferenceCallback;
+            err = walkEnv->FollowReferences(0, NULL, NULL, &callbacks, &graph);
+            if (check_jvmti_error(walkEnv, err, "Unable to follow references.\n"))
+            {
+                disposeHeapWalkEnv(walkEnv);
+                walkEnv = NULL;
+                double walkMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                sendRetainedSize(graph, topN, walkMs);
+            }
+        }
+        if (walkEnv != NULL)
+        {
+            disposeHeapWalkEnv(walkEnv);
+        }
+    });
+}
@@ -0,0 +1,200 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <jvmti.h>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "agentOptions.hpp"
+#include "scheduler.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+#define SCHEDULER_LOCAL_FRAME_SIZE 64
+
+struct periodic_task_t
+{
+    seconds interval;
+    steady_clock::time_point nextRun;
+    agentTask_t task;
+};
+
+static mutex schedulerMutex;
+static condition_variable schedulerCondition;
+static map<string, periodic_task_t> periodicTasks;
+static deque<agentTask_t> pendingTasks;
+static thread schedulerThread;
+static bool schedulerStopping = false;
+
+static void runTask(agentTask_t& task, JNIEnv *jniEnv)
+{
+    /* the thread never returns to Java, so release the local references each task creates */
+    if (jniEnv->PushLocalFrame(SCHEDULER_LOCAL_FRAME_SIZE) == JNI_OK)
+    {
+        task(jvmti, jniEnv);
+        jniEnv->PopLocalFrame(NULL);
+    }
+}
+
+static void runScheduler(void)
+{
+    JNIEnv *jniEnv = NULL;
+
+    if (javaVM->AttachCurrentThreadAsDaemon((void **)&jniEnv, NULL) != JNI_OK)
+    {
+        printf("ERROR: unable to attach scheduler thread to the VM.\n");
+        return;
+    }
+
+    unique_lock<mutex> lock(schedulerMutex);
+    while (true)
+    {
+        if (!pendingTasks.empty())
+        {
+            agentTask_t task = pendingTasks.front();
+            pendingTasks.pop_front();
+            lock.unlock();
+            runTask(task, jniEnv);
+            lock.lock();
+            continue;
+        }
+
+        if (schedulerStopping)
+        {
+            break;
+        }
+
+        steady_clock::time_point now = steady_clock::now();
+        steady_clock::time_point wakeUp = now + hours(1);
+        agentTask_t dueTask;
+        for (auto& entry : periodicTasks)
+        {
+            if (entry.second.nextRun <= now)
+            {
+                dueTask = entry.second.task;
+                entry.second.nextRun = now + entry.second.interval;
+                break;
+            }
+            wakeUp = min(wakeUp, entry.second.nextRun);
+        }
+
+        if (dueTask)
+        {
+            lock.unlock();
+            runTask(dueTask, jniEnv);
+            lock.lock();
+            continue;
+        }
+
+        schedulerCondition.wait_until(lock, wakeUp);
+    }
+
+    /* flush every periodic task before the VM goes away; the tasks are moved out first since
+     * they run unlocked and may schedule or cancel tasks themselves */
+    vector<agentTask_t> finalTasks;
+    for (auto& entry : periodicTasks)
+    {
+        finalTasks.push_back(move(entry.second.task));
+    }
+    periodicTasks.clear();
+    lock.unlock();
+
+    for (agentTask_t& task : finalTasks)
+    {
+        runTask(task, jniEnv);
+    }
+
+    javaVM->DetachCurrentThread();
+}
+
+/* requires schedulerMutex */
+static void startSchedulerThread(void)
+{
+    if (!schedulerThread.joinable() && !schedulerStopping)
+    {
+        schedulerThread = thread(&runScheduler);
+    }
+}
+
+void schedulePeriodicTask(const string& name, int intervalSeconds, agentTask_t task)
+{
+    lock_guard<mutex> lock(schedulerMutex);
+    periodic_task_t& periodicTask = periodicTasks[name];
+    periodicTask.interval = seconds(intervalSeconds > 0 ? intervalSeconds : 1);
+    periodicTask.nextRun = steady_clock::now() + periodicTask.interval;
+    periodicTask.task = task;
+    startSchedulerThread();
+    schedulerCondition.notify_one();
+}
+
+void cancelPeriodicTask(const string& name)
+{
+    lock_guard<mutex> lock(schedulerMutex);
+    auto entry = periodicTasks.find(name);
+    if (entry != periodicTasks.end())
+    {
+        /* run the final report on the scheduler thread so it never overlaps a periodic run */
+        pendingTasks.push_back(entry->second.task);
+        periodicTasks.erase(entry);
+        schedulerCondition.notify_one();
+    }
+}
+
+void runPeriodicTaskNow(const string& name)
+{
+    lock_guard<mutex> lock(schedulerMutex);
+    auto entry = periodicTasks.find(name);
+    if (entry != periodicTasks.end())
+    {
+        pendingTasks.push_back(entry->second.task);
+        schedulerCondition.notify_one();
+    }
+}
+
+void submitTask(agentTask_t task)
+{
+    lock_guard<mutex> lock(schedulerMutex);
+    pendingTasks.push_back(task);
+    startSchedulerThread();
+    schedulerCondition.notify_one();
+}
+
+void shutDownScheduler(void)
+{
+    {
+        lock_guard<mutex> lock(schedulerMutex);
+        schedulerStopping = true;
+        schedulerCondition.notify_one();
+    }
+
+    if (schedulerThread.joinable())
+    {
+        schedulerThread.join();
+    }
+}
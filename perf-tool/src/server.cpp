@@ -40,6 +40,7 @@
 
 #include "agentOptions.hpp"
 #include "perf.hpp"
+#include "perfSession.hpp"
 #include "utils.hpp"
 
 using namespace std;
@@ -178,8 +179,17 @@ void Server::handleServer()
             while(delayedCommands.size() > 0)
             {
                 if (delayedCommands[0].delayTill <= currentTime) {
-                    agentCommand(delayedCommands[0].command);
+                    json delayedCommand = delayedCommands[0].command;
                     delayedCommands.erase(delayedCommands.begin());
+                    try
+                    {
+                        dispatchCommand(delayedCommand);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        std::cerr << e.what() << '\n';
+                        std::cerr << "Improper delayed command: " << delayedCommand.dump() << '\n';
+                    }
                 } else{
                     break;
                 }
@@ -209,13 +219,21 @@ void Server::execCommand(json command)
                 }
         });
     }
-    else if ((command["functionality"].get<std::string>()).compare("perf"))
+    else
+    {
+        dispatchCommand(command);
+    }
+}
+
+void Server::dispatchCommand(const json& command)
+{
+    if ((command["functionality"].get<std::string>()).compare("perf"))
     {
         agentCommand(command);
     }
     else
     {
-        startPerfThread(command["time"]);
+        perfSessions.handleCommand(command);
     }
 }
 
@@ -266,24 +284,13 @@ void Server::handleMessagingClients(string message)
     loggingClient->logData(message, "Server");
 }
 
-void Server::startPerfThread(int time)
-{
-    pid_t currPid;
-
-    currPid = getpid();
-    perfThread = thread(&perfProcess, currPid, time);
-}
-
 void Server::shutDownServer()
 {
     keepPolling = false;
 
-    /* wait on perf processing thread to join so its data can be sent before server closing */
-    if (perfThread.joinable())
-    {
-        cout << "Waiting on perf data." << endl;
-        perfThread.join();
-    }
+    /* stop the perf sessions and wait for them so their data can be sent before server closing */
+    cout << "Waiting on perf data." << endl;
+    perfSessions.stopAll();
 
     handleMessagingClients("Server shutting down");
 
@@ -0,0 +1,120 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <jvmti.h>
+
+#include "infra.hpp"
+#include "json.hpp"
+#include "stacks.hpp"
+
+using json = nlohmann::json;
+
+static inline uint64_t mixHash(uint64_t hash, uint64_t value)
+{
+    /* FNV-1a style mixing on whole words */
+    hash ^= value;
+    hash *= 0x100000001b3ULL;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+uint64_t hashStackTrace(const jvmtiFrameInfo *frames, jint count)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (jint i = 0; i < count; i++)
+    {
+        hash = mixHash(hash, (uint64_t)(uintptr_t)frames[i].method);
+        hash = mixHash(hash, (uint64_t)frames[i].location);
+    }
+    return mixHash(hash, (uint64_t)count);
+}
+
+int getLineNumber(jvmtiEnv *jvmtiEnv, jmethodID method, jlocation location)
+{
+    jvmtiError err;
+    jint entryCount;
+    jvmtiLineNumberEntry *lineTable;
+    int lineNumber = -1;
+
+    err = jvmtiEnv->GetLineNumberTable(method, &entryCount, &lineTable);
+    if (err != JVMTI_ERROR_NONE)
+    {
+        /* native and synthetic methods have no line numbers */
+        return -1;
+    }
+    for (jint i = 0; i < entryCount; i++)
+    {
+        if (lineTable[i].start_location > location)
+        {
+            break;
+        }
+        lineNumber = lineTable[i].line_number;
+    }
+    err = jvmtiEnv->Deallocate((unsigned char*)lineTable);
+    check_jvmti_error(jvmtiEnv, err, "Unable to deallocate lineTable.\n");
+
+    return lineNumber;
+}
+
+json describeFrame(jvmtiEnv *jvmtiEnv, jmethodID method, jlocation location)
+{
+    json jFrame;
+    jvmtiError err;
+    char *methodName;
+    char *methodSignature;
+    char *declaringClassName;
+    jclass declaringClass;
+
+    err = jvmtiEnv->GetMethodName(method, &methodName, &methodSignature, NULL);
+    if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Method Name.\n"))
+    {
+        jFrame["methodName"] = methodName;
+        jFrame["methodSignature"] = methodSignature;
+        jvmtiEnv->Deallocate((unsigned char*)methodName);
+        jvmtiEnv->Deallocate((unsigned char*)methodSignature);
+    }
+    err = jvmtiEnv->GetMethodDeclaringClass(method, &declaringClass);
+    if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Method Declaring Class.\n"))
+    {
+        err = jvmtiEnv->GetClassSignature(declaringClass, &declaringClassName, NULL);
+        if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Method Declaring Class Signature.\n"))
+        {
+            jFrame["methodClass"] = declaringClassName;
+            jvmtiEnv->Deallocate((unsigned char*)declaringClassName);
+        }
+    }
+    jFrame["methodLineNum"] = getLineNumber(jvmtiEnv, method, location);
+
+    return jFrame;
+}
+
+json describeStackTrace(jvmtiEnv *jvmtiEnv, const jvmtiFrameInfo *frames, jint count)
+{
+    auto jFrames = json::array();
+
+    for (jint i = 0; i < count; i++)
+    {
+        jFrames.push_back(describeFrame(jvmtiEnv, frames[i].method, frames[i].location));
+    }
+    return jFrames;
+}
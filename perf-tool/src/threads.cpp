@@ -0,0 +1,304 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <ibmjvmti.h>
+#include <jvmti.h>
+#include <mutex>
+#include <regex>
+#include <shared_mutex>
+#include <string>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "agentOptions.hpp"
+#include "exception.hpp"
+#include "hwCounters.hpp"
+#include "infra.hpp"
+#include "perfSampler.hpp"
+#include "threads.hpp"
+
+using namespace std;
+
+atomic<int> threadFilterGeneration {0};
+thread_local int threadFilterVerdictGeneration = 0;
+thread_local bool threadFilterVerdict = true;
+
+static mutex threadFilterMutex;
+static int lastThreadFilterGeneration = 0;
+static vector<regex> threadNameFilters;
+static vector<regex> threadGroupFilters;
+
+static shared_mutex javaThreadsMutex;
+static unordered_map<pid_t, java_thread_info_t> javaThreads;
+static jvmtiExtensionFunction getOSThreadID = NULL;
+static once_flag getOSThreadIDLookup;
+
+static bool matchesAny(const vector<regex>& patterns, const char *value)
+{
+    if (patterns.empty())
+    {
+        return true;
+    }
+    for (const regex& pattern : patterns)
+    {
+        if (regex_search(value, pattern))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void setThreadFilter(const vector<string>& namePatterns, const vector<string>& groupPatterns)
+{
+    /* compile outside of the lock, regex throws on a malformed pattern */
+    vector<regex> names, groups;
+    for (const string& pattern : namePatterns)
+    {
+        names.emplace_back(pattern, regex::optimize);
+    }
+    for (const string& pattern : groupPatterns)
+    {
+        groups.emplace_back(pattern, regex::optimize);
+    }
+
+    lock_guard<mutex> lock(threadFilterMutex);
+    threadNameFilters.swap(names);
+    threadGroupFilters.swap(groups);
+    /* a new generation makes every thread reclassify itself on its next event */
+    threadFilterGeneration = ++lastThreadFilterGeneration;
+}
+
+void clearThreadFilter(void)
+{
+    lock_guard<mutex> lock(threadFilterMutex);
+    threadNameFilters.clear();
+    threadGroupFilters.clear();
+    threadFilterGeneration = 0;
+}
+
+bool classifyThread(jvmtiEnv *jvmtiEnv, JNIEnv* jniEnv, jthread thread, int generation)
+{
+    jvmtiError err;
+    jvmtiThreadInfo threadInfo;
+    jvmtiThreadGroupInfo groupInfo;
+    bool interesting = true;
+
+    memset(&threadInfo, 0, sizeof(threadInfo));
+    err = jvmtiEnv->GetThreadInfo(thread, &threadInfo);
+    if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Thread Info.\n"))
+    {
+        lock_guard<mutex> lock(threadFilterMutex);
+        interesting = matchesAny(threadNameFilters, threadInfo.name != NULL ? threadInfo.name : "");
+        if (interesting && !threadGroupFilters.empty())
+        {
+            memset(&groupInfo, 0, sizeof(groupInfo));
+            interesting = false;
+            if (threadInfo.thread_group != NULL)
+            {
+                err = jvmtiEnv->GetThreadGroupInfo(threadInfo.thread_group, &groupInfo);
+                if (check_jvmti_error(jvmtiEnv, err, "Unable to retrieve Thread Group Info.\n"))
+                {
+                    interesting = matchesAny(threadGroupFilters, groupInfo.name != NULL ? groupInfo.name : "");
+                    if (groupInfo.parent != NULL && jniEnv != NULL)
+                    {
+                        jniEnv->DeleteLocalRef(groupInfo.parent);
+                    }
+                    jvmtiEnv->Deallocate((unsigned char*)groupInfo.name);
+                }
+            }
+        }
+        jvmtiEnv->Deallocate((unsigned char*)threadInfo.name);
+        if (jniEnv != NULL)
+        {
+            if (threadInfo.thread_group != NULL)
+            {
+                jniEnv->DeleteLocalRef(threadInfo.thread_group);
+            }
+            if (threadInfo.context_class_loader != NULL)
+            {
+                jniEnv->DeleteLocalRef(threadInfo.context_class_loader);
+            }
+        }
+    }
+
+    threadFilterVerdict = interesting;
+    threadFilterVerdictGeneration = generation;
+    return interesting;
+}
+
+/* Frees what GetExtensionFunctions allocated: the strings and arrays of every entry, then the array */
+static void deallocateExtensionFunctions(jvmtiEnv *jvmtiEnv, jint count, jvmtiExtensionFunctionInfo *functions)
+{
+    for (jint i = 0; i < count; i++)
+    {
+        jvmtiEnv->Deallocate((unsigned char*)functions[i].id);
+        jvmtiEnv->Deallocate((unsigned char*)functions[i].short_description);
+        for (jint j = 0; j < functions[i].param_count; j++)
+        {
+            jvmtiEnv->Deallocate((unsigned char*)functions[i].params[j].name);
+        }
+        jvmtiEnv->Deallocate((unsigned char*)functions[i].params);
+        jvmtiEnv->Deallocate((unsigned char*)functions[i].errors);
+    }
+    jvmtiEnv->Deallocate((unsigned char*)functions);
+}
+
+/* Returns the OS TID of thread, using OpenJ9's extension. Without it only the current thread's TID is known. */
+static pid_t getThreadTid(jvmtiEnv *jvmtiEnv, jthread thread, bool current)
+{
+    /* the function pointer stays valid, only the description of the extensions is freed */
+    call_once(getOSThreadIDLookup, [jvmtiEnv]() {
+        jint extensionFunctionCount = 0;
+        jvmtiExtensionFunctionInfo *extensionFunctions = NULL;
+
+        if (!check_jvmti_error(jvmtiEnv, jvmtiEnv->GetExtensionFunctions(&extensionFunctionCount, &extensionFunctions), "Unable to get extension functions.\n"))
+        {
+            return;
+        }
+        for (jint i = 0; i < extensionFunctionCount; i++)
+        {
+            if (strcmp(extensionFunctions[i].id, COM_IBM_GET_OS_THREAD_ID) == 0)
+            {
+                getOSThreadID = extensionFunctions[i].func;
+                break;
+            }
+        }
+        deallocateExtensionFunctions(jvmtiEnv, extensionFunctionCount, extensionFunctions);
+    });
+
+    if (getOSThreadID != NULL)
+    {
+        jlong tid = 0;
+        if (getOSThreadID(jvmtiEnv, thread, &tid) == JVMTI_ERROR_NONE)
+        {
+            return (pid_t)tid;
+        }
+    }
+    return current ? (pid_t)syscall(SYS_gettid) : 0;
+}
+
+static bool getJavaThreadInfo(jvmtiEnv *jvmtiEnv, JNIEnv* jniEnv, jthread thread, java_thread_info_t& info)
+{
+    jvmtiThreadInfo threadInfo;
+    jvmtiThreadGroupInfo groupInfo;
+
+    memset(&threadInfo, 0, sizeof(threadInfo));
+    if (!check_jvmti_error(jvmtiEnv, jvmtiEnv->GetThreadInfo(thread, &threadInfo), "Unable to retrieve Thread Info.\n"))
+    {
+        return false;
+    }
+    info.name = (threadInfo.name != NULL) ? threadInfo.name : "";
+    info.group.clear();
+    jvmtiEnv->Deallocate((unsigned char*)threadInfo.name);
+    if (threadInfo.thread_group != NULL)
+    {
+        memset(&groupInfo, 0, sizeof(groupInfo));
+        if (check_jvmti_error(jvmtiEnv, jvmtiEnv->GetThreadGroupInfo(threadInfo.thread_group, &groupInfo), "Unable to retrieve Thread Group Info.\n"))
+        {
+            info.group = (groupInfo.name != NULL) ? groupInfo.name : "";
+            jvmtiEnv->Deallocate((unsigned char*)groupInfo.name);
+            if (groupInfo.parent != NULL)
+            {
+                jniEnv->DeleteLocalRef(groupInfo.parent);
+            }
+        }
+        jniEnv->DeleteLocalRef(threadInfo.thread_group);
+    }
+    if (threadInfo.context_class_loader != NULL)
+    {
+        jniEnv->DeleteLocalRef(threadInfo.context_class_loader);
+    }
+    return true;
+}
+
+static void registerJavaThread(jvmtiEnv *jvmtiEnv, JNIEnv* jniEnv, jthread thread, bool current)
+{
+    java_thread_info_t info;
+    pid_t tid = getThreadTid(jvmtiEnv, thread, current);
+
+    if (tid != 0 && getJavaThreadInfo(jvmtiEnv, jniEnv, thread, info))
+    {
+        unique_lock<shared_mutex> lock(javaThreadsMutex);
+        javaThreads[tid] = move(info);
+    }
+}
+
+void registerLiveJavaThreads(jvmtiEnv *jvmtiEnv, JNIEnv* jniEnv)
+{
+    jint threadCount = 0;
+    jthread *threads = NULL;
+
+    if (check_jvmti_error(jvmtiEnv, jvmtiEnv->GetAllThreads(&threadCount, &threads), "Unable to get all threads.\n"))
+    {
+        for (jint i = 0; i < threadCount; i++)
+        {
+            registerJavaThread(jvmtiEnv, jniEnv, threads[i], false);
+            jniEnv->DeleteLocalRef(threads[i]);
+        }
+        jvmtiEnv->Deallocate((unsigned char*)threads);
+    }
+}
+
+bool lookupJavaThread(pid_t tid, java_thread_info_t& info)
+{
+    shared_lock<shared_mutex> lock(javaThreadsMutex);
+    auto thread = javaThreads.find(tid);
+    if (thread == javaThreads.end())
+    {
+        return false;
+    }
+    info = thread->second;
+    return true;
+}
+
+JNIEXPORT void JNICALL ThreadStart(jvmtiEnv *jvmtiEnv, JNIEnv* jniEnv, jthread thread)
+{
+    registerJavaThread(jvmtiEnv, jniEnv, thread, true);
+
+    /* ThreadStart runs on the new thread, so classify it before it can post any other event */
+    int generation = threadFilterGeneration.load(std::memory_order_relaxed);
+    if (generation != 0)
+    {
+        classifyThread(jvmtiEnv, jniEnv, thread, generation);
+    }
+
+    /* per-thread perf events must be opened for the new thread's own TID */
+    addThreadToPerfSamplers();
+    addThreadToHwCounters();
+}
+
+JNIEXPORT void JNICALL ThreadEnd(jvmtiEnv *jvmtiEnv, JNIEnv* jniEnv, jthread thread)
+{
+    /* ThreadEnd runs on the ending thread, its TID may be reused once it returns */
+    pid_t tid = getThreadTid(jvmtiEnv, thread, true);
+
+    releasePendingThrow(jniEnv);
+    removeThreadFromPerfSamplers();
+    removeThreadFromHwCounters();
+
+    unique_lock<shared_mutex> lock(javaThreadsMutex);
+    javaThreads.erase(tid);
+}
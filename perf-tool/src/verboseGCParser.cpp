@@ -0,0 +1,262 @@
+/*******************************************************************************
+ * Copyright (c) 2020, 2020 IBM Corp. and others
+ *
+ * This program and the accompanying materials are made available under
+ * the terms of the Eclipse Public License 2.0 which accompanies this
+ * distribution and is available at https://www.eclipse.org/legal/epl-2.0/
+ * or the Apache License, Version 2.0 which accompanies this distribution and
+ * is available at https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * This Source Code may also be made available under the following
+ * Secondary Licenses when the conditions for such availability set
+ * forth in the Eclipse Public License, v. 2.0 are satisfied: GNU
+ * General Public License, version 2 with the GNU Classpath
+ * Exception [1] and GNU General Public License, version 2 with the
+ * OpenJDK Assembly Exception [2].
+ *
+ * [1] https://www.gnu.org/software/classpath/license.html
+ * [2] http://openjdk.java.net/legal/assembly-exception.html
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR Apache-2.0 OR GPL-2.0 WITH Classpath-exception-2.0 OR LicenseRef-GPL-2.0 WITH Assembly-exception
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "verboseGCParser.hpp"
+
+using namespace std;
+
+VerboseGCParser::VerboseGCParser(function<void(const verbose_gc_cycle_t&)> _onCycle) : onCycle(_onCycle)
+{
+    resetCycle();
+}
+
+void VerboseGCParser::resetCycle(void)
+{
+    memset(&cycle, 0, sizeof(cycle));
+    haveBefore = false;
+    section = SECTION_NONE;
+}
+
+void VerboseGCParser::parse(const char *record, size_t length)
+{
+    if (!carry.empty())
+    {
+        /* rare: the previous record ended in the middle of a tag */
+        carry.append(record, length);
+        string text;
+        text.swap(carry);
+        size_t consumed = parseTags(text);
+        carry.assign(text, consumed, string::npos);
+        return;
+    }
+
+    string_view text(record, length);
+    size_t consumed = parseTags(text);
+    if (consumed < length)
+    {
+        carry.assign(record + consumed, length - consumed);
+    }
+}
+
+/* Scans every complete tag in text and returns how many bytes were consumed */
+size_t VerboseGCParser::parseTags(string_view text)
+{
+    size_t position = 0;
+
+    while (true)
+    {
+        size_t open = text.find('<', position);
+        if (open == string_view::npos)
+        {
+            return text.size();
+        }
+        size_t close = text.find('>', open);
+        if (close == string_view::npos)
+        {
+            return open;
+        }
+        position = close + 1;
+
+        string_view tag = text.substr(open + 1, close - open - 1);
+        if (tag.empty() || tag[0] == '?' || tag[0] == '!')
+        {
+            continue;
+        }
+
+        bool closing = (tag[0] == '/');
+        if (closing)
+        {
+            tag.remove_prefix(1);
+        }
+        size_t nameEnd = tag.find_first_of(" \t\r\n/");
+        string_view name = tag.substr(0, nameEnd);
+
+        /* attributes are name="value" pairs, values are views into the record */
+        attributeCount = 0;
+        size_t i = (nameEnd == string_view::npos) ? tag.size() : nameEnd;
+        while (!closing && i < tag.size() && attributeCount < VERBOSE_GC_MAX_ATTRIBUTES)
+        {
+            size_t equals = tag.find('=', i);
+            if (equals == string_view::npos || equals + 1 >= tag.size())
+            {
+                break;
+            }
+            char quote = tag[equals + 1];
+            size_t valueEnd = tag.find(quote, equals + 2);
+            if ((quote != '"' && quote != '\'') || valueEnd == string_view::npos)
+            {
+                break;
+            }
+            size_t nameStart = tag.find_first_not_of(" \t\r\n", i);
+            attributes[attributeCount].name = tag.substr(nameStart, equals - nameStart);
+            attributes[attributeCount].value = tag.substr(equals + 2, valueEnd - equals - 2);
+            attributeCount++;
+            i = valueEnd + 1;
+        }
+
+        handleTag(name, closing);
+    }
+}
+
+string_view VerboseGCParser::attribute(const char *name) const
+{
+    for (int i = 0; i < attributeCount; i++)
+    {
+        if (attributes[i].name == name)
+        {
+            return attributes[i].value;
+        }
+    }
+    return string_view();
+}
+
+uint64_t VerboseGCParser::attributeInt(const char *name) const
+{
+    char buffer[32];
+    string_view value = attribute(name);
+    size_t length = min(value.size(), sizeof(buffer) - 1);
+
+    memcpy(buffer, value.data(), length);
+    buffer[length] = '\0';
+    return strtoull(buffer, NULL, 10);
+}
+
+double VerboseGCParser::attributeDouble(const char *name) const
+{
+    char buffer[32];
+    string_view value = attribute(name);
+    size_t length = min(value.size(), sizeof(buffer) - 1);
+
+    memcpy(buffer, value.data(), length);
+    buffer[length] = '\0';
+    return strtod(buffer, NULL);
+}
+
+void VerboseGCParser::copyAttribute(const char *name, char *destination) const
+{
+    string_view value = attribute(name);
+    size_t length = min(value.size(), (size_t)VERBOSE_GC_MAX_TYPE_LENGTH - 1);
+
+    memcpy(destination, value.data(), length);
+    destination[length] = '\0';
+}
+
+void VerboseGCParser::handleTag(string_view name, bool closing)
+{
+    if (closing)
+    {
+        if (name == "gc-start" || name == "gc-end")
+        {
+            section = SECTION_NONE;
+        }
+        return;
+    }
+
+    if (name == "exclusive-start")
+    {
+        resetCycle();
+        inExclusive = true;
+        cycle.id = attributeInt("id");
+        cycle.intervalMs = attributeDouble("intervalms");
+    }
+    else if (!inExclusive)
+    {
+        /* concurrent activity outside of a pause is not reported */
+        return;
+    }
+    else if (name == "exclusive-end")
+    {
+        cycle.pauseMs = attributeDouble("durationms");
+        inExclusive = false;
+        onCycle(cycle);
+    }
+    else if (name == "af-start")
+    {
+        /* allocation failure in the nursery or tenure space */
+        copyAttribute("type", cycle.cause);
+        cycle.bytesRequested = attributeInt("totalBytesRequested");
+    }
+    else if (name == "sys-start")
+    {
+        /* System.gc() and other explicit requests */
+        copyAttribute("reason", cycle.cause);
+    }
+    else if (name == "concurrent-kickoff" && cycle.cause[0] == '\0')
+    {
+        strcpy(cycle.cause, "concurrent-kickoff");
+    }
+    else if (name == "cycle-start" || (name == "gc-start" && cycle.type[0] == '\0'))
+    {
+        copyAttribute("type", cycle.type);
+    }
+    else if (name == "gc-end")
+    {
+        cycle.gcMs += attributeDouble("durationms");
+        cycle.gcCount++;
+    }
+
+    if (name == "gc-start")
+    {
+        /* occupancy before the first collection of the pause */
+        section = haveBefore ? SECTION_NONE : SECTION_BEFORE;
+        haveBefore = true;
+    }
+    else if (name == "gc-end")
+    {
+        /* occupancy after the last collection of the pause */
+        section = SECTION_AFTER;
+    }
+    else if (section != SECTION_NONE && (name == "mem-info" || name == "mem"))
+    {
+        verbose_gc_space_t *space = NULL;
+        if (name == "mem-info")
+        {
+            space = &cycle.heap;
+        }
+        else if (attribute("type") == "nursery")
+        {
+            space = &cycle.nursery;
+        }
+        else if (attribute("type") == "tenure")
+        {
+            space = &cycle.tenure;
+        }
+
+        if (space != NULL)
+        {
+            uint64_t total = attributeInt("total");
+            uint64_t used = total - min(total, attributeInt("free"));
+            space->total = total;
+            if (section == SECTION_BEFORE)
+            {
+                space->usedBefore = used;
+            }
+            else
+            {
+                space->usedAfter = used;
+            }
+        }
+    }
+}
@@ -24,14 +24,25 @@
 
 #include <iostream>
 #include <jvmti.h>
+#include <mutex>
 
 #include "agentOptions.hpp"
 #include "infra.hpp"
+#include "json.hpp"
+#include "verboseGCParser.hpp"
 
 using namespace std;
+using json = nlohmann::json;
 
 std::atomic<int> verboseSampleCount {0};
 std::atomic<int> verboseSampleRate {1};
+std::atomic<verbose_log_format_t> verboseLogFormat {VERBOSE_LOG_FORMAT_STRUCTURED};
+
+static void sendVerboseGCCycle(const verbose_gc_cycle_t& cycle);
+
+/* the parser keeps state between records, so records are fed to it one at a time */
+static mutex verboseGCParserMutex;
+static VerboseGCParser verboseGCParser(sendVerboseGCCycle);
 
 void VerboseLogSubscriber::setVerboseGCLogSampleRate(int rate) {
     if (rate > 0) {
@@ -39,6 +50,39 @@ void VerboseLogSubscriber::setVerboseGCLogSampleRate(int rate) {
     }
 }
 
+void VerboseLogSubscriber::setVerboseGCLogFormat(verbose_log_format_t format) {
+    verboseLogFormat = format;
+}
+
+static json spaceToJson(const verbose_gc_space_t& space)
+{
+    json jSpace;
+    jSpace["usedBefore"] = space.usedBefore;
+    jSpace["usedAfter"] = space.usedAfter;
+    jSpace["total"] = space.total;
+    return jSpace;
+}
+
+static void sendVerboseGCCycle(const verbose_gc_cycle_t& cycle)
+{
+    json jCycle;
+    jCycle["id"] = cycle.id;
+    jCycle["type"] = cycle.type;
+    jCycle["cause"] = cycle.cause;
+    jCycle["bytesRequested"] = cycle.bytesRequested;
+    jCycle["intervalMs"] = cycle.intervalMs;
+    jCycle["pauseMs"] = cycle.pauseMs;
+    jCycle["gcMs"] = cycle.gcMs;
+    jCycle["gcCount"] = cycle.gcCount;
+    jCycle["heap"] = spaceToJson(cycle.heap);
+    jCycle["nursery"] = spaceToJson(cycle.nursery);
+    jCycle["tenure"] = spaceToJson(cycle.tenure);
+
+    json j;
+    j["verboseGC"] = jCycle;
+    sendToServer(j.dump());
+}
+
 void VerboseLogSubscriber::Subscribe()
 {
     jvmtiError rc;
@@ -109,13 +153,24 @@ void VerboseLogSubscriber::Unsubscribe()
 
 jvmtiError verboseSubscriberCallback(jvmtiEnv *jvmti_env, const char *record, jlong length, void *user_data)
 {
-    if (verboseSampleCount % verboseSampleRate == 0)
+    verbose_log_format_t format = verboseLogFormat;
+
+    if (format != VERBOSE_LOG_FORMAT_RAW)
     {
-        string s = string(record);
-        sendToServer(s);
+        lock_guard<mutex> lock(verboseGCParserMutex);
+        verboseGCParser.parse(record, (size_t)length);
     }
 
-    verboseSampleCount++;
+    if (format != VERBOSE_LOG_FORMAT_STRUCTURED)
+    {
+        if (verboseSampleCount % verboseSampleRate == 0)
+        {
+            string s = string(record, (size_t)length);
+            sendToServer(s);
+        }
+
+        verboseSampleCount++;
+    }
 
     return JVMTI_ERROR_NONE;
 }